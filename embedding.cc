@@ -4,7 +4,27 @@
  */
 #include "embedding.h"
 
+#include <unordered_map>
+
 namespace knowledgeembedding {
+namespace {
+// the first probe array of the counting tables of a vocab thread
+const int32_t kVocabPartSize = 1 << 16;
+
+// " cls-<tag>-acc: x" of every tag, result maps a tag to (wrong, right)
+string EvalResultStr(const string &type,
+                     const map<string, pair<int32_t, int32_t>> &result) {
+    string res = "";
+    for (auto it = result.begin(); it != result.end(); it++) {
+        float acc = it->second.second /
+            (it->second.first + it->second.second + 0.0);
+        res += " " + type + "-" + it->first + "-acc: " + utils::GetFormatStr(acc);
+    }
+    utils::StringTrim(&res);
+    return res;
+}
+} // namespace
+
 void Embedding::InitArgs(const string &confpath) {
     args_conf_ = make_shared<ArgsConf>();
     assert(args_conf_->Init(confpath));
@@ -12,19 +32,28 @@ void Embedding::InitArgs(const string &confpath) {
     args_conf_->PrintArgs();
     cerr << "------------------------------------------------------" << endl;
     args_conf_->CheckArgs();
+    if (!utils::InitKernels(args_conf_->simd_)) {
+        cerr << "Error: simd " << args_conf_->simd_
+            << " is unknown or not supported by this cpu" << endl;
+        exit(1);
+    }
+    cerr << std::left << setw(30) << "simd kernels:"
+        << utils::GetKernels().name << endl;
 }
 
-void Embedding::AddVocab(const vector<string> &parts,
-                         const string &text,
+void Embedding::AddVocab(const vector<string_view> &parts,
+                         string_view text,
                          HashTable* hash_word,
                          HashTable* hash_phrase,
                          uint64_t &word_counter,
                          uint64_t &phrase_counter) {
-    if (utils::StringTrim(text) == "") {
+    if (utils::TrimView(text).empty()) {
         return;
     }
-    // add word list
-    vector<string> word_list;
+    // add word list, the words are views into text
+    static thread_local vector<string_view> word_list;
+    static thread_local vector<string_view> ngram_list;
+    static thread_local string ngram_arena;
     utils::GetSegedWordList(text, word_list);
     if ((parts[0] == "cls" || parts[0] == "skip" || parts[0] == "pair")
         && (static_cast<int>(word_list.size()) < args_conf_->minlen_
@@ -32,95 +61,164 @@ void Embedding::AddVocab(const vector<string> &parts,
         return;
     }
     word_counter += word_list.size();
-    hash_word->AddWord(word_list, true);
+    // subwords are added when the tables of all threads are merged
+    hash_word->AddWord(word_list, false);
 
     // add ngram list
-    vector<string> ngram_list;
-    utils::GetNgramWordList(word_list, ngram_list, args_conf_->ngram_);
+    utils::GetNgramWordList(word_list, ngram_list, args_conf_->ngram_, &ngram_arena);
     phrase_counter += ngram_list.size();
-    hash_phrase->AddWord(ngram_list);
+    hash_phrase->AddWord(ngram_list, false);
 }
 
-void Embedding::LoadTrainVocab(bool only_count) {
-    cerr << "load train vocab with file : " << args_conf_->trainfile_ << endl;
-    ifstream fin(args_conf_->trainfile_);
-    assert(fin.is_open());
-
-    HashTable* hash_word =
-        new HashTable(args_conf_, args_conf_->maxvocabsize_);
-    HashTable* hash_phrase =
-        new HashTable(args_conf_, args_conf_->maxphrasesize_);
-    vector<string> parts;
+void Embedding::LoadTrainVocabThread(int32_t thread_id,
+                                     int64_t begin,
+                                     int64_t end,
+                                     bool only_count,
+                                     VocabPart *part) {
+    utils::LineReader reader(train_file_, begin, end);
+    // the thread tables grow with their range and never filter, the
+    // merged table filters on the counts of the whole corpus
+    part->hash_word = make_shared<HashTable>(args_conf_, kVocabPartSize, true);
+    part->hash_phrase = make_shared<HashTable>(args_conf_, kVocabPartSize, true);
+    vector<string_view> parts;
     string line;
-    vector<string> word_list;
-    uint64_t line_counter = 0;
-    uint64_t word_counter = 0;
-    uint64_t phrase_counter = 0;
-
-    while (utils::GetLine(fin, line)) {
-        line_counter++;
-        utils::StringTrim(&line);
+    string pair_text;
+    string cls_tag;
+    string number;
+    string_view view;
+    while (reader.Next(&view)) {
+        line.assign(view.data(), view.size());
+        part->line_counter++;
         utils::StringToLower(&line);
-        utils::StringSplit(line, "\t", parts);
+        utils::SplitView(utils::TrimView(line), '\t', parts);
         utils::TrimVector(&parts);
-        string text = "";
+        string_view text;
         if (parts.size() == 2 && parts[0] == "skip"
             && args_conf_->useskipgram_) {
             text = parts[1];
         } else if (parts.size() == 5 && parts[0] == "pair"
             && args_conf_->usepair_) {
-            string pair_tag = parts[1];
-            string label = parts[2];
-            text = parts[3] + " . " + parts[4];
-            pair_tag_map_[pair_tag] = 1;
-            string key = pair_tag + "\t" + label;
-            if (pair_tag_count_map_.find(key) == pair_tag_count_map_.end()) {
-                pair_tag_count_map_[key] = 1;
-            } else {
-                pair_tag_count_map_[key] += 1;
-            }
+            string pair_tag(parts[1]);
+            pair_text.assign(parts[3]);
+            pair_text.append(" . ");
+            pair_text.append(parts[4]);
+            text = pair_text;
+            part->pair_tag_map[pair_tag] = 1;
+            part->pair_tag_count_map[pair_tag + "\t" + string(parts[2])] += 1;
         } else if (parts.size() == 4 && parts[0] == "cls"
             && args_conf_->usecls_) {
             text = parts[3];
-            string cls_tag = parts[1];
+            cls_tag.assign(parts[1]);
+            number.assign(parts[2]);
             int32_t label = 0;
-            if (!utils::StringToNumber(parts[2], &label) || label < 0) {
+            if (!utils::StringToNumber(number, &label) || label < 0) {
                 continue;
             }
-            if (cls_tag_map_.find(cls_tag) == cls_tag_map_.end()) {
-                cls_tag_map_[cls_tag] = label;
-                cls_tag_count_map_[cls_tag + "\t" + to_string(label)] = 1;
+            if (part->cls_tag_map.find(cls_tag) == part->cls_tag_map.end()) {
+                part->cls_tag_map[cls_tag] = label;
+                part->cls_first_label_map[cls_tag] = label;
             } else {
-                cls_tag_map_[cls_tag] = max(label, cls_tag_map_[cls_tag]);
+                part->cls_tag_map[cls_tag] = max(label, part->cls_tag_map[cls_tag]);
             }
-            string tag_label = cls_tag + "\t" + to_string(label);
-            if (cls_tag_count_map_.find(tag_label)
-            == cls_tag_count_map_.end()) {
-                cls_tag_count_map_[tag_label] = 1;
-            } else {
-                cls_tag_count_map_[tag_label] += 1;
+            part->cls_tag_count_map[cls_tag + "\t" + to_string(label)] += 1;
+        }
+        if (part->line_counter % 1000 == 0) {
+            uint64_t line_counter = (vocab_line_counter_ += 1000);
+            if (thread_id == 0) {
+                cerr.flags(ios::left);
+                cerr << "\rRead line: " << setw(12) << line_counter << flush;
             }
         }
-        if (text == "" || only_count) {
+        if (text.empty() || only_count) {
             continue;
         }
-        AddVocab(parts, text, hash_word, hash_phrase,
-                 word_counter, phrase_counter);
+        AddVocab(parts, text, part->hash_word.get(), part->hash_phrase.get(),
+                 part->word_counter, part->phrase_counter);
+    }
+}
 
-        if (line_counter % 1000 == 0) {
-            cerr.flags(ios::left);
-            cerr << "\rRead line: " << setw(12) << line_counter
-                << "  words(M): " << setw(10) << (word_counter / 1000000.0)
-                << "  phrase(M): " << setw(10) << (phrase_counter / 1000000.0)
-                << flush;
+void Embedding::MergeVocabPart(vector<VocabPart> &parts) {
+    uint64_t line_counter = 0;
+    uint64_t word_counter = 0;
+    uint64_t phrase_counter = 0;
+    for (uint32_t i = 0; i < parts.size(); i++) {
+        const VocabPart &part = parts[i];
+        line_counter += part.line_counter;
+        word_counter += part.word_counter;
+        phrase_counter += part.phrase_counter;
+        for (auto it = part.cls_tag_map.begin(); it != part.cls_tag_map.end(); it++) {
+            if (cls_tag_map_.find(it->first) == cls_tag_map_.end()) {
+                cls_tag_map_[it->first] = it->second;
+                // the first example of a tag is counted twice
+                string tag_label = it->first + "\t"
+                    + to_string(part.cls_first_label_map.at(it->first));
+                cls_tag_count_map_[tag_label] += 1;
+            } else {
+                cls_tag_map_[it->first] = max(it->second, cls_tag_map_[it->first]);
+            }
+        }
+        for (auto it = part.cls_tag_count_map.begin();
+             it != part.cls_tag_count_map.end(); it++) {
+            cls_tag_count_map_[it->first] += it->second;
+        }
+        for (auto it = part.pair_tag_map.begin(); it != part.pair_tag_map.end(); it++) {
+            pair_tag_map_[it->first] = it->second;
+        }
+        for (auto it = part.pair_tag_count_map.begin();
+             it != part.pair_tag_count_map.end(); it++) {
+            pair_tag_count_map_[it->first] += it->second;
         }
     }
-    fin.close();
     cerr.flags(ios::left);
     cerr << "\rRead line: " << setw(12) << line_counter
         << "  words(M): " << setw(10) << (word_counter / 1000000.0)
         << "  phrase(M): " << setw(10) << (phrase_counter / 1000000.0)
         << endl;
+    args_conf_->totallinenum_ = line_counter;
+}
+
+void Embedding::LoadTrainVocab(bool only_count) {
+    cerr << "load train vocab with file : " << args_conf_->trainfile_ << endl;
+    if (!train_file_.Open(args_conf_->trainfile_)) {
+        cerr << "Error : can not map train file " << args_conf_->trainfile_ << endl;
+        exit(1);
+    }
+    train_file_.AdviseSequential();
+    // every thread counts the lines beginning in its byte range
+    utils::SplitFileByLine(args_conf_->trainfile_, args_conf_->thread_, train_ranges_);
+    const vector<pair<int64_t, int64_t>> &ranges = train_ranges_;
+    vector<VocabPart> parts(ranges.size());
+    vocab_line_counter_ = 0;
+    vector<thread> threads;
+    for (int32_t i = 0; i < int32_t(ranges.size()); i++) {
+        threads.push_back(thread([=, &parts, &ranges]() {
+                        LoadTrainVocabThread(i, ranges[i].first, ranges[i].second,
+                                             only_count, &parts[i]);
+                        }));
+    }
+    for (auto it = threads.begin(); it != threads.end(); it++) {
+        it->join();
+    }
+    MergeVocabPart(parts);
+    if (only_count) {
+        return;
+    }
+
+    vector<shared_ptr<HashTable>> word_tables;
+    vector<shared_ptr<HashTable>> phrase_tables;
+    for (uint32_t i = 0; i < parts.size(); i++) {
+        word_tables.push_back(parts[i].hash_word);
+        phrase_tables.push_back(parts[i].hash_phrase);
+    }
+    HashTable* hash_word =
+        new HashTable(args_conf_, args_conf_->maxvocabsize_);
+    HashTable* hash_phrase =
+        new HashTable(args_conf_, args_conf_->maxphrasesize_);
+    hash_word->Merge(word_tables, args_conf_->thread_, true);
+    hash_phrase->Merge(phrase_tables, args_conf_->thread_);
+    word_tables.clear();
+    phrase_tables.clear();
+    parts.clear();
 
     hash_word->Rebuild(args_conf_->minwordfreq_);
     hash_phrase->Rebuild(args_conf_->minphrasefreq_);
@@ -130,23 +228,32 @@ void Embedding::LoadTrainVocab(bool only_count) {
     cerr << "phrase table size (after filter) : "
      << hash_phrase->wordsize_ << endl;
 
-    hash_table_ = make_shared<HashTable>(args_conf_,
+    shared_ptr<HashTable> vocab = make_shared<HashTable>(args_conf_,
                 args_conf_->maxvocabsize_ + args_conf_->maxphrasesize_);
-    hash_table_->CombineWordVec(hash_word->wordvec_);
-    hash_table_->CombineWordVec(hash_phrase->wordvec_);
+    vocab->CombineWordVec(*hash_word);
+    vocab->CombineWordVec(*hash_phrase);
+    vocab->Rebuild(-1);
+    if (hash_table_ != NULL) {
+        // continued training: the loaded words keep their positions
+        uint32_t old_size = hash_table_->Size();
+        hash_table_->Append(*vocab);
+        cerr << "new words of train file : "
+            << hash_table_->Size() - old_size << endl;
+    } else {
+        hash_table_ = vocab;
+    }
+    vocab.reset();
 
-    hash_table_->Rebuild(-1);
     hash_table_->InitDiscardTable(args_conf_->freqsample_);
-    cerr << "hash_table_.size: " << hash_table_->wordvec_.size() << endl;
+    cerr << "hash_table_.size: " << hash_table_->Size() << endl;
 
     cerr << "After filter words(M): "
-        << setw(10) << (hash_word->wordvec_).size() / 1000000.0
+        << setw(10) << hash_word->Size() / 1000000.0
         << "  phrase(M): "
-        << setw(10) << (hash_phrase->wordvec_).size() / 1000000.0
+        << setw(10) << hash_phrase->Size() / 1000000.0
         << "  combine(M): "
-        << setw(10) << (hash_table_->wordvec_).size() / 1000000.0
+        << setw(10) << hash_table_->Size() / 1000000.0
         << endl;
-    args_conf_->totallinenum_ = line_counter;
     delete hash_word;
     hash_word = NULL;
     delete hash_phrase;
@@ -219,21 +326,37 @@ void Embedding::LoadEvalExample() {
 }
 
 void Embedding::InitModel() {
-    input_layer_ = make_shared<InputLayer>(args_conf_, hash_table_);
-    skip_model_ = make_shared<Model>(args_conf_, ModelName::skip,
-                hash_table_->wordvec_.size(),
-        input_layer_, "skip", hash_table_);
-    skip_model_->InitNegTable();
+    if (input_layer_ != NULL) {
+        // continued training: new words and labels get new rows, the
+        // loaded rows stay trained
+        input_layer_->Grow(hash_table_->Size());
+        skip_model_->Grow(hash_table_->Size(), cls_tag_count_map_);
+    } else {
+        input_layer_ = make_shared<InputLayer>(args_conf_, hash_table_);
+        skip_model_ = make_shared<Model>(args_conf_, ModelName::skip,
+                    hash_table_->Size(),
+            input_layer_, "skip", hash_table_);
+        skip_model_->InitNegTable();
+    }
 
     for (auto it = cls_tag_map_.begin(); it != cls_tag_map_.end(); it++) {
+        auto model_it = cls_model_map_.find(it->first);
+        if (model_it != cls_model_map_.end()) {
+            model_it->second->Grow(it->second + 1, cls_tag_count_map_);
+            continue;
+        }
         cerr << "initing cls-" << it->first
             << "(" << it->second << ")" << endl;
         shared_ptr<Model> clsi = make_shared<Model>(args_conf_, ModelName::cls,
                     it->second + 1, input_layer_, it->first, hash_table_);
         clsi->InitNegTable(cls_tag_count_map_);
+        clsi->InitTree(cls_tag_count_map_);
         cls_model_map_[it->first] = clsi;
     }
     for (auto it = pair_tag_map_.begin(); it != pair_tag_map_.end(); it++) {
+        if (pair_model_map_.find(it->first) != pair_model_map_.end()) {
+            continue;
+        }
         shared_ptr<Model> pairi =
         make_shared<Model>(args_conf_, ModelName::pair,
                     2, input_layer_, it->first, hash_table_);
@@ -282,11 +405,13 @@ void Embedding::GetDistance(const string &input_word,
     hash_table_->GetWordPos(words, idx_vec);
     if (idx_vec.size() >= 1) {
         priority_queue<pair<float, uint32_t>> heap;
-        input_layer_->GetNearestNeighbor(idx_vec, heap, query_type_);
+        // the input words may be among the nearest rows
+        input_layer_->GetNearestNeighbor(idx_vec, heap, query_type_,
+                                         top_size + idx_vec.size());
         int32_t i = 0;
         while (i < top_size && heap.size() > 0) {
-            if (hash_table_->wordvec_[heap.top().second].word != input_word) {
-                string word = hash_table_->wordvec_[heap.top().second].word;
+            string_view word = hash_table_->Word(heap.top().second);
+            if (word != input_word) {
                 cerr << word << "\t\t" << heap.top().first << endl;
                 i++;
             }
@@ -296,6 +421,14 @@ void Embedding::GetDistance(const string &input_word,
 }
 
 void Embedding::Distance(int32_t top_size) {
+    // the neighbor search scans float rows
+    input_layer_->Dequantize();
+    if (args_conf_->annindex_
+        && !input_layer_->LoadAnnIndex(args_conf_->modeldir_)) {
+        cerr << "building ann index ... " << endl;
+        input_layer_->BuildAnnIndex(args_conf_->annlist_, args_conf_->thread_);
+        input_layer_->SaveAnnIndex(args_conf_->modeldir_);
+    }
     string word;
     cerr << "---------------- " << query_type_
         << "(_all / _word / _phrase) input word('exit' to quit) : " << flush;
@@ -320,6 +453,7 @@ void Embedding::GetSentenceVec() {
     vector<int32_t> word_idx_vec;
     vector<string> ngram_list;
     vector<int32_t> phrase_idx_vec;
+    vector<int32_t> subwords;
 
     while (utils::GetLine(cin, sentence)) {
         word_list.clear();
@@ -330,6 +464,15 @@ void Embedding::GetSentenceVec() {
         utils::StringTrim(&sentence);
         utils::GetSegedWordList(sentence, word_list);
         hash_table_->GetWordPos(word_list, word_idx_vec);
+        if (input_layer_->UseOovSubword()) {
+            for (uint32_t i = 0; i < word_list.size(); i++) {
+                if (!hash_table_->HasWord(word_list[i])) {
+                    input_layer_->GetOovSubwords(word_list[i], subwords);
+                    word_idx_vec.insert(word_idx_vec.end(),
+                                subwords.begin(), subwords.end());
+                }
+            }
+        }
 
         if (args_conf_->ngram_ > 0) {
             utils::GetNgramWordList(word_list, ngram_list, args_conf_->ngram_);
@@ -339,7 +482,7 @@ void Embedding::GetSentenceVec() {
         }
         if (word_idx_vec.size() > 0) {
             vector<float> hiddenVec(args_conf_->dim_, 0);
-            input_layer_->GetLayerByIdxs(word_idx_vec, hiddenVec, 1, false);
+            input_layer_->GetLayerByIdxs(word_idx_vec, hiddenVec, 1);
             cout << sentence << "\t"
                 << utils::JoinVector(hiddenVec, " ") << endl;
         }
@@ -353,9 +496,10 @@ void Embedding::PredictCls(const pair<vector<int32_t>, string> &example,
     vector<string> parts;
     vector<pair<int32_t, float>> pred;
     utils::StringSplit(example.second, "\t", parts);
-    if (parts.size() == 2
-        && cls_model_map_.find(parts[0]) != cls_model_map_.end()) {
-        cls_model_map_[parts[0]]->PredictClsScore(example.first, pred);
+    // find only, the predict workers share the map
+    auto it = (parts.size() == 2) ? cls_model_map_.find(parts[0]) : cls_model_map_.end();
+    if (it != cls_model_map_.end()) {
+        it->second->PredictClsScore(example.first, pred);
         if (pred.size() > 0) {
             predict_res.first = pred[0].first;
             predict_res.second = pred[0].second;
@@ -368,10 +512,9 @@ float Embedding::PredictPair(pair<pair<vector<int32_t>,
     float score = -1;
     vector<string> parts;
     utils::StringSplit(example.second, "\t", parts);
-    if (parts.size() == 2
-        && pair_model_map_.find(parts[0]) != pair_model_map_.end()) {
-        score = pair_model_map_[parts[0]]->PredictPair(
-                    example.first.first, example.first.second);
+    auto it = (parts.size() == 2) ? pair_model_map_.find(parts[0]) : pair_model_map_.end();
+    if (it != pair_model_map_.end()) {
+        score = it->second->PredictPair(example.first.first, example.first.second);
     }
     return score;
 }
@@ -437,19 +580,118 @@ void Embedding::Predict(const string &line, string &res) {
     }
 }
 
-void Embedding::Predict() {
-    cerr << "predicting ... " << endl;
+void Embedding::PredictLines(vector<string> &lines, string *output) {
+    output->clear();
     string res = "";
-    string line = "";
-    while (utils::GetLine(cin, line)) {
-        utils::StringToLower(&line);
-        Predict(line, res);
+    for (uint32_t i = 0; i < lines.size(); i++) {
+        utils::StringToLower(&lines[i]);
+        Predict(lines[i], res);
         if (res != "") {
-            cout << res << endl;
+            output->append(res);
+            output->push_back('\n');
         }
     }
 }
 
+void Embedding::Predict() {
+    cerr << "predicting ... " << endl;
+    if (args_conf_->predictthread_ <= 1) {
+        string res = "";
+        string line = "";
+        while (utils::GetLine(cin, line)) {
+            utils::StringToLower(&line);
+            Predict(line, res);
+            if (res != "") {
+                cout << res << endl;
+            }
+        }
+        return;
+    }
+    // the main thread reads batches and writes their output in input
+    // order, the workers predict the batches in any order
+    uint32_t batch_size = args_conf_->predictbatch_;
+    uint64_t max_pending = 2 * uint64_t(args_conf_->predictthread_);
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    std::queue<pair<uint64_t, vector<string>>> work_queue;
+    // reorder buffer of the finished batches
+    map<uint64_t, string> done_map;
+    bool finished = false;
+
+    vector<thread> threads;
+    for (int32_t i = 0; i < args_conf_->predictthread_; i++) {
+        threads.push_back(thread([&]() {
+            pair<uint64_t, vector<string>> batch;
+            string output;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    work_cv.wait(lock, [&]() {
+                        return finished || !work_queue.empty();
+                    });
+                    if (work_queue.empty()) {
+                        return;
+                    }
+                    batch = std::move(work_queue.front());
+                    work_queue.pop();
+                }
+                PredictLines(batch.second, &output);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    done_map[batch.first].swap(output);
+                }
+                done_cv.notify_all();
+            }
+        }));
+    }
+
+    uint64_t read_seq = 0;
+    uint64_t write_seq = 0;
+    string output;
+    bool eof = false;
+    while (!eof || write_seq < read_seq) {
+        if (!eof && read_seq - write_seq < max_pending) {
+            vector<string> lines;
+            lines.reserve(batch_size);
+            string line;
+            while (lines.size() < batch_size && getline(cin, line)) {
+                lines.push_back(line);
+            }
+            eof = (lines.size() < batch_size);
+            if (!lines.empty()) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    work_queue.push(make_pair(read_seq, std::move(lines)));
+                }
+                work_cv.notify_one();
+                read_seq++;
+            }
+            continue;
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            done_cv.wait(lock, [&]() {
+                return done_map.find(write_seq) != done_map.end();
+            });
+            auto it = done_map.find(write_seq);
+            output.swap(it->second);
+            done_map.erase(it);
+        }
+        cout << output;
+        write_seq++;
+    }
+    cout << flush;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+    }
+    work_cv.notify_all();
+    for (auto it = threads.begin(); it != threads.end(); it++) {
+        it->join();
+    }
+}
+
 void Embedding::EvalCls(map<string, pair<int32_t, int32_t>> *result) {
     result->clear();
     vector<string> parts;
@@ -503,16 +745,23 @@ void Embedding::EvalPair(map<string, pair<int32_t, int32_t>> *result) {
 }
 
 void Embedding::PrintEvalInfo(float progress, bool is_eval) {
+    // loss, examples/sec and words/sec of a task
+    auto model_info = [](const string &name, Model *model) {
+        float example_speed = 0;
+        float word_speed = 0;
+        model->GetSpeed(&example_speed, &word_speed);
+        return " " + name + "-loss: " + utils::GetFormatStr(model->GetLoss())
+            + " " + name + "-ex/s: " + to_string(int64_t(example_speed))
+            + " " + name + "-words/s: " + to_string(int64_t(word_speed));
+    };
     string res = "Progress: " + utils::GetFormatStr(progress)
         + " learn-rate: " + utils::GetFormatStr(args_conf_->curlearnrate_)
-        + " skip-loss: " + utils::GetFormatStr(skip_model_->GetLoss());
+        + model_info("skip", skip_model_.get());
     for (auto it = cls_model_map_.begin(); it != cls_model_map_.end(); it++) {
-        res += " cls-" + it->first + "-loss: "
-            + utils::GetFormatStr(it->second->GetLoss());
+        res += model_info("cls-" + it->first, it->second.get());
     }
     for (auto it = pair_model_map_.begin(); it != pair_model_map_.end(); it++) {
-        res += " pair-" + it->first + "-loss: "
-            + utils::GetFormatStr(it->second->GetLoss());
+        res += model_info("pair-" + it->first, it->second.get());
     }
     if (is_eval) {
         string eval_cls_str = "";
@@ -520,113 +769,573 @@ void Embedding::PrintEvalInfo(float progress, bool is_eval) {
         map<string, pair<int32_t, int32_t>> eval_result;
         if (args_conf_->usecls_) {
             EvalCls(&eval_result);
-            for (auto it = eval_result.begin(); it != eval_result.end(); it++) {
-                float acc = it->second.second /
-                    (it->second.first + it->second.second + 0.0);
-                eval_cls_str += " cls-" + it->first + "-acc: "
-                            + utils::GetFormatStr(acc);
-            }
-            utils::StringTrim(&eval_cls_str);
+            eval_cls_str = EvalResultStr("cls", eval_result);
         }
         if (args_conf_->usepair_) {
             EvalPair(&eval_result);
-            for (auto it = eval_result.begin(); it != eval_result.end(); it++) {
-                float acc = it->second.second /
-                    (it->second.first + it->second.second + 0.0);
-                eval_pair_str += " pair-" + it->first + "-acc: "
-                            + utils::GetFormatStr(acc);
-            }
-            utils::StringTrim(&eval_pair_str);
+            eval_pair_str = EvalResultStr("pair", eval_result);
         }
         res += "\n\n---" + eval_cls_str + "  " + eval_pair_str  + "\n";
     }
     cerr << res << endl;
 }
 
-void Embedding::TrainThread(int32_t thread_id) {
-    assert(args_conf_->totallinenum_ > 0);
-    assert(args_conf_->epoch_ > 0);
-    ifstream fin(args_conf_->trainfile_);
-    assert(fin.is_open());
-
-    utils::Seek(&fin, thread_id * utils::Size(&fin) / args_conf_->thread_);
+void Embedding::InitAsyncEval() {
+    eval_examples_.clear();
+    eval_rows_.clear();
+    eval_models_.clear();
+    // the models by "<type>\t<tag>", the cls eval reads a copy of the output
+    map<string, int32_t> model_idx;
+    for (auto it = cls_model_map_.begin(); it != cls_model_map_.end(); it++) {
+        model_idx["cls\t" + it->first] = int32_t(eval_models_.size());
+        eval_models_.push_back(it->second);
+    }
+    for (auto it = pair_model_map_.begin(); it != pair_model_map_.end(); it++) {
+        model_idx["pair\t" + it->first] = int32_t(eval_models_.size());
+        eval_models_.push_back(it->second);
+    }
+    eval_outputs_.assign(eval_models_.size(), vector<float>());
+    // input row -> row of the copy
+    std::unordered_map<int32_t, int32_t> row_idx;
+    auto map_rows = [&](const vector<int32_t> &idx_vec, MergedIdxs *merged) {
+        input_layer_->MergeIdxs(idx_vec, merged);
+        for (uint32_t i = 0; i < merged->rows.size(); i++) {
+            int32_t &row = merged->rows[i].first;
+            auto it = row_idx.find(row);
+            if (it == row_idx.end()) {
+                it = row_idx.insert(make_pair(row, int32_t(eval_rows_.size()))).first;
+                eval_rows_.push_back(row);
+            }
+            row = it->second;
+        }
+    };
     vector<string> parts;
-    string line;
-    uint32_t line_counter = 0;
-    // jump the line after seek
-    utils::ReadLine(&fin, &line, thread_id);
-    while (args_conf_->curlinenum_ <
-       args_conf_->totallinenum_ * args_conf_->epoch_) {
-        line_counter += 1;
-        args_conf_->curlinenum_ += 1;
-        float progress = args_conf_->curlinenum_ /
-                (args_conf_->totallinenum_ * args_conf_->epoch_ * 1.0);
-        if (line_counter % args_conf_->getlossevery_ == 0) {
-            args_conf_->curlearnrate_ = args_conf_->learnrate_ * (1 - progress);
+    EvalExample example;
+    for (uint32_t i = 0; i < cls_eval_.size(); i++) {
+        utils::StringSplit(cls_eval_[i].second, "\t", parts);
+        auto it = (parts.size() == 2) ? model_idx.find("cls\t" + parts[0]) : model_idx.end();
+        if (it == model_idx.end() || !utils::StringToNumber(parts[1], &example.label)
+            || example.label < 0) {
+            continue;
         }
-        utils::ReadLine(&fin, &line, thread_id);
-        utils::StringToLower(&line);
-        if (line == "") {
+        example.name = static_cast<int32_t>(ModelName::cls);
+        example.model = it->second;
+        example.tag = parts[0];
+        map_rows(cls_eval_[i].first, &example.rows_1);
+        eval_examples_.push_back(example);
+    }
+    for (uint32_t i = 0; i < pair_eval_.size(); i++) {
+        utils::StringSplit(pair_eval_[i].second, "\t", parts);
+        auto it = (parts.size() == 2) ? model_idx.find("pair\t" + parts[0]) : model_idx.end();
+        if (it == model_idx.end() || !utils::StringToNumber(parts[1], &example.label)
+            || example.label < 0) {
             continue;
         }
-        utils::StringSplit(line, "\t", parts);
-        utils::TrimVector(&parts);
-        string text = "";
-        string cls_tag = "";
-        int32_t label = -1;
-        if (parts.size() == 2 && parts[0] == "skip"
-            && args_conf_->useskipgram_) {
-            text = parts[1];
-            if (text == "") continue;
-            skip_model_->UpdateSkip(text);
-        } else if (parts.size() == 4 && parts[0] == "cls"
-                   && args_conf_->usecls_) {
-            cls_tag = parts[1];
-            if (!utils::StringToNumber(parts[2], &label) || label < 0
-                || cls_model_map_.find(cls_tag) == cls_model_map_.end()) {
+        example.name = static_cast<int32_t>(ModelName::pair);
+        example.model = it->second;
+        example.tag = parts[0];
+        map_rows(pair_eval_[i].first.first, &example.rows_1);
+        map_rows(pair_eval_[i].first.second, &example.rows_2);
+        eval_examples_.push_back(example);
+    }
+    eval_offset_ = 0;
+    eval_backoff_ = 1;
+    eval_skipped_ = false;
+    eval_example_seconds_ = 0;
+    eval_time_ = std::chrono::steady_clock::now();
+    cerr << "async eval examples: " << eval_examples_.size()
+        << " input rows: " << eval_rows_.size() << endl;
+}
+
+void Embedding::StartAsyncEval(float progress) {
+    auto now = std::chrono::steady_clock::now();
+    double interval = std::chrono::duration<double>(now - eval_time_).count();
+    eval_time_ = now;
+    if (eval_examples_.empty()) {
+        return;
+    }
+    if (eval_busy_) {
+        // the last eval took longer than the interval
+        eval_backoff_ /= 2;
+        eval_skipped_ = true;
+        cerr << "eval of progress " << utils::GetFormatStr(progress)
+            << " skipped, the last eval is still running" << endl;
+        return;
+    }
+    if (eval_thread_.joinable()) {
+        eval_thread_.join();
+    }
+    if (!eval_skipped_) {
+        eval_backoff_ = 1;
+    }
+    eval_skipped_ = false;
+    // the first eval takes all examples, the next ones what fits in half
+    // of the interval, the eval thread shares the cpus with training
+    uint32_t total = uint32_t(eval_examples_.size());
+    double fit = total;
+    if (eval_example_seconds_ > 0) {
+        fit = interval * 0.5 / eval_example_seconds_;
+    }
+    uint32_t size = uint32_t(min(double(total), max(fit * eval_backoff_, 1.0)));
+    uint32_t step = total / size;
+    eval_offset_ = (eval_offset_ + 1) % step;
+    // the train threads go on while the rows are copied
+    input_layer_->SnapshotRows(eval_rows_, &eval_input_);
+    // the cls models come first, pair models have no output to read
+    for (uint32_t i = 0; i < cls_model_map_.size(); i++) {
+        eval_models_[i]->Snapshot(&eval_outputs_[i]);
+    }
+    eval_busy_ = true;
+    uint32_t offset = eval_offset_;
+    eval_thread_ = thread([=]() {
+                    AsyncEvalThread(progress, size, offset);
+                    });
+}
+
+void Embedding::AsyncEvalThread(float progress, uint32_t size, uint32_t offset) {
+    utils::LowerThreadPriority();
+    auto start = std::chrono::steady_clock::now();
+    uint32_t dim = args_conf_->dim_;
+    uint32_t step = uint32_t(eval_examples_.size()) / size;
+    vector<float> hidden_vec_1(dim);
+    vector<float> hidden_vec_2(dim);
+    map<string, pair<int32_t, int32_t>> cls_result;
+    map<string, pair<int32_t, int32_t>> pair_result;
+    for (uint32_t i = 0; i < size; i++) {
+        const EvalExample &example = eval_examples_[offset + i * step];
+        Model *model = eval_models_[example.model].get();
+        std::fill(hidden_vec_1.begin(), hidden_vec_1.end(), 0);
+        input_layer_->GetLayerByIdxs(example.rows_1, eval_input_.data(), hidden_vec_1.data());
+        int32_t pre = -1;
+        pair<int32_t, int32_t> *res = NULL;
+        if (example.name == static_cast<int32_t>(ModelName::cls)) {
+            pre = model->PredictCls(hidden_vec_1.data(), eval_outputs_[example.model]);
+            // not counted, as in EvalCls
+            if (pre < 0) {
                 continue;
             }
-            text = parts[3];
-            if (text == "") continue;
-            cls_model_map_[cls_tag]->UpdateCls(text, uint32_t(label));
-            if (cls_model_map_[cls_tag]->use_as_skip_example_
-                && args_conf_->useskipgram_) {
-                skip_model_->UpdateSkip(text);
+            res = &cls_result[example.tag];
+        } else {
+            std::fill(hidden_vec_2.begin(), hidden_vec_2.end(), 0);
+            input_layer_->GetLayerByIdxs(example.rows_2, eval_input_.data(),
+                                         hidden_vec_2.data());
+            pre = (model->PredictPair(hidden_vec_1.data(), hidden_vec_2.data()) > 0.5) ? 1 : 0;
+            res = &pair_result[example.tag];
+        }
+        res->first += (pre != example.label) ? 1 : 0;
+        res->second += (pre == example.label) ? 1 : 0;
+    }
+    double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    // averaged over the evals, a short eval may run in one time slice
+    double example_seconds = seconds / size;
+    eval_example_seconds_ = (eval_example_seconds_ > 0)
+        ? 0.5 * (eval_example_seconds_ + example_seconds) : example_seconds;
+    // one write, the train thread 0 prints its progress lines meanwhile
+    string res = "Eval progress: " + utils::GetFormatStr(progress)
+        + " examples: " + to_string(size) + "/" + to_string(eval_examples_.size())
+        + " seconds: " + utils::GetFormatStr(seconds)
+        + "\n\n---" + EvalResultStr("cls", cls_result)
+        + "  " + EvalResultStr("pair", pair_result) + "\n\n";
+    cerr << res << flush;
+    eval_busy_ = false;
+}
+
+void Embedding::WaitAsyncEval() {
+    if (eval_thread_.joinable()) {
+        eval_thread_.join();
+    }
+    eval_busy_ = false;
+}
+
+void Embedding::ParseExample(string_view raw_line, TrainExample *example) {
+    // per thread buffers, the fields are views into line
+    static thread_local string line;
+    static thread_local vector<string_view> parts;
+    static thread_local string key;
+    static thread_local string number;
+    example->name = 0;
+    line.assign(raw_line.data(), raw_line.size());
+    utils::StringToLower(&line);
+    string_view text_line = utils::TrimView(line);
+    if (text_line.empty()) {
+        return;
+    }
+    utils::SplitView(text_line, '\t', parts);
+    utils::TrimVector(&parts);
+    int32_t label = -1;
+    if (parts.size() == 2 && parts[0] == "skip"
+        && args_conf_->useskipgram_) {
+        if (parts[1].empty()) {
+            return;
+        }
+        input_layer_->GetTextIds(parts[1], &example->text_1);
+        example->name = static_cast<int32_t>(ModelName::skip);
+    } else if ((parts.size() == 4 && parts[0] == "cls" && args_conf_->usecls_)
+               || (parts.size() == 5 && parts[0] == "pair" && args_conf_->usepair_)) {
+        key.assign(parts[0]);
+        key.push_back('\t');
+        key.append(parts[1]);
+        number.assign(parts[2]);
+        auto it = train_model_idx_.find(key);
+        if (!utils::StringToNumber(number, &label) || label < 0
+            || it == train_model_idx_.end()) {
+            return;
+        }
+        if (parts[3].empty() || (parts.size() == 5 && parts[4].empty())) {
+            return;
+        }
+        input_layer_->GetTextIds(parts[3], &example->text_1);
+        if (parts.size() == 5) {
+            input_layer_->GetTextIds(parts[4], &example->text_2);
+            example->name = static_cast<int32_t>(ModelName::pair);
+        } else {
+            example->name = static_cast<int32_t>(ModelName::cls);
+        }
+        example->model = it->second;
+        example->label = label;
+    }
+}
+
+void Embedding::UpdateExample(const TrainExample &example, utils::Rng *rng) {
+    ModelName name = static_cast<ModelName>(example.name);
+    if (name == ModelName::skip) {
+        skip_model_->UpdateSkip(example.text_1, rng);
+    } else if (name == ModelName::cls) {
+        Model *clsi = train_models_[example.model].get();
+        clsi->UpdateCls(example.text_1, uint32_t(example.label), rng);
+        if (clsi->use_as_skip_example_ && args_conf_->useskipgram_) {
+            skip_model_->UpdateSkip(example.text_1, rng);
+        }
+    } else if (name == ModelName::pair) {
+        Model *pairi = train_models_[example.model].get();
+        pairi->UpdatePair(example.text_1, example.text_2,
+                          uint32_t(example.label), rng);
+        if (pairi->use_as_skip_example_ && args_conf_->useskipgram_) {
+            skip_model_->UpdateSkip(example.text_1, rng);
+            skip_model_->UpdateSkip(example.text_2, rng);
+        }
+    }
+}
+
+// record: name [model label n_word n_phrase words phrases]
+// pair records repeat n_word n_phrase words phrases for text_2
+void Embedding::WriteExample(ofstream &ofs, const TrainExample &example) {
+    utils::WriteBinaryVec(ofs, &example.name, 1);
+    if (example.name == 0) {
+        return;
+    }
+    utils::WriteBinaryVec(ofs, &example.model, 1);
+    utils::WriteBinaryVec(ofs, &example.label, 1);
+    const TextIds *texts[2] = {&example.text_1, &example.text_2};
+    int32_t text_num = (example.name == static_cast<int32_t>(ModelName::pair)) ? 2 : 1;
+    for (int32_t i = 0; i < text_num; i++) {
+        int32_t sizes[2] = {int32_t(texts[i]->words.size()),
+                            int32_t(texts[i]->phrases.size())};
+        utils::WriteBinaryVec(ofs, sizes, 2);
+        utils::WriteBinaryVec(ofs, texts[i]->words.data(), sizes[0]);
+        utils::WriteBinaryVec(ofs, texts[i]->phrases.data(), sizes[1]);
+    }
+}
+
+bool Embedding::ReadExample(utils::Int32Reader *reader, TrainExample *example) {
+    if (!reader->Next(&example->name)) {
+        return false;
+    }
+    if (example->name == 0) {
+        return true;
+    }
+    TextIds *texts[2] = {&example->text_1, &example->text_2};
+    int32_t text_num = (example->name == static_cast<int32_t>(ModelName::pair)) ? 2 : 1;
+    bool ok = reader->Next(&example->model) && reader->Next(&example->label);
+    for (int32_t i = 0; ok && i < text_num; i++) {
+        int32_t word_size = 0;
+        int32_t phrase_size = 0;
+        ok = reader->Next(&word_size) && reader->Next(&phrase_size)
+            && reader->Next(word_size, &texts[i]->words)
+            && reader->Next(phrase_size, &texts[i]->phrases);
+    }
+    if (!ok) {
+        cerr << "Error : corpus cache is truncated" << endl;
+        exit(1);
+    }
+    return true;
+}
+
+bool Embedding::CompileCorpusThread(int32_t thread_id) {
+    const string &file = corpus_cache_files_[thread_id];
+    ofstream ofs(file, ios::binary);
+    if (!ofs.is_open()) {
+        return false;
+    }
+    // the header is written again with the counts at the end
+    utils::BinaryHeader header;
+    utils::InitBinaryHeader(utils::BinaryKind::corpus, 0, 0, &header);
+    header.dtype = static_cast<uint32_t>(utils::DataType::int32);
+    utils::WriteBinaryHeader(ofs, header);
+
+    utils::LineReader reader(train_file_, train_ranges_[thread_id].first,
+                             train_ranges_[thread_id].second);
+    TrainExample example;
+    string_view view;
+    uint64_t start = uint64_t(ofs.tellp());
+    while (reader.Next(&view)) {
+        ParseExample(view, &example);
+        WriteExample(ofs, example);
+        header.row++;
+    }
+    header.col = (uint64_t(ofs.tellp()) - start) / sizeof(int32_t);
+    ofs.seekp(0);
+    utils::WriteBinaryHeader(ofs, header);
+    utils::CloseOutFile(&ofs);
+    // a full disk fails the writes, not the open
+    if (ofs.fail()) {
+        remove(file.c_str());
+        return false;
+    }
+
+    corpus_cache_[thread_id] = make_shared<utils::MappedFile>();
+    const int32_t *data = NULL;
+    uint64_t size = 0;
+    utils::MapBinaryInt32(file, utils::BinaryKind::corpus,
+                          corpus_cache_[thread_id].get(), &data, &size);
+    // the mapping keeps the data, the disk space is freed when it is
+    // closed, also if the process dies
+    remove(file.c_str());
+    corpus_cache_[thread_id]->AdviseSequential();
+    corpus_reader_[thread_id] = utils::Int32Reader(data, size);
+    return true;
+}
+
+void Embedding::CompileCorpus() {
+    cerr << "compile corpus cache ... " << endl;
+    int32_t thread_num = int32_t(train_ranges_.size());
+    corpus_cache_files_.clear();
+    corpus_cache_.assign(thread_num, NULL);
+    corpus_reader_.assign(thread_num, utils::Int32Reader());
+    string dir = args_conf_->corpuscachedir_;
+    if (dir.empty()) {
+        const char *tmpdir = getenv("TMPDIR");
+        dir = (tmpdir != NULL && tmpdir[0] != '\0') ? tmpdir : "/tmp";
+    }
+    string name = args_conf_->trainfile_.substr(args_conf_->trainfile_.rfind('/') + 1);
+    for (int32_t i = 0; i < thread_num; i++) {
+        corpus_cache_files_.push_back(dir + "/" + name + ".cache."
+            + to_string(getpid()) + "." + to_string(i));
+    }
+    vector<thread> threads;
+    vector<char> done(thread_num, 0);
+    for (int32_t i = 0; i < thread_num; i++) {
+        threads.push_back(thread([&, i]() {
+                        done[i] = CompileCorpusThread(i) ? 1 : 0;
+                        }));
+    }
+    for (auto it = threads.begin(); it != threads.end(); it++) {
+        it->join();
+    }
+    if (std::find(done.begin(), done.end(), 0) != done.end()) {
+        cerr << "Warning : can not write the corpus cache into " << dir
+            << ", train on the text" << endl;
+        for (int32_t i = 0; i < thread_num; i++) {
+            if (corpus_cache_[i] != NULL) {
+                corpus_cache_[i]->Close();
             }
-        } else if (parts.size() == 5 && parts[0] == "pair"
-                   && args_conf_->usepair_) {
-            string pair_tag = parts[1];
-            if (!utils::StringToNumber(parts[2], &label) || label < 0
-                || pair_model_map_.find(pair_tag) == pair_model_map_.end()) {
+        }
+        corpus_cache_.clear();
+        corpus_reader_.clear();
+        corpus_cache_files_.clear();
+        return;
+    }
+    uint64_t cache_size = 0;
+    for (int32_t i = 0; i < thread_num; i++) {
+        cache_size += corpus_cache_[i]->Size();
+    }
+    cerr << "corpus cache(M): " << (cache_size / 1000000.0) << endl;
+}
+
+void Embedding::WaitTurn(int32_t thread_id) {
+    std::unique_lock<std::mutex> lock(turn_mutex_);
+    turn_cv_.wait(lock, [&]() { return turn_ == thread_id; });
+}
+
+void Embedding::PassTurn(int32_t thread_id, bool done) {
+    {
+        std::lock_guard<std::mutex> lock(turn_mutex_);
+        turn_done_[thread_id] = done;
+        int32_t thread_num = int32_t(turn_done_.size());
+        for (int32_t i = 1; i <= thread_num; i++) {
+            int32_t next = (thread_id + i) % thread_num;
+            if (!turn_done_[next]) {
+                turn_ = next;
+                break;
+            }
+        }
+    }
+    turn_cv_.notify_all();
+}
+
+void Embedding::TrainThread(int32_t thread_id) {
+    assert(args_conf_->totallinenum_ > 0);
+    assert(args_conf_->epoch_ > 0);
+    assert(thread_id < int32_t(train_ranges_.size()));
+    Model::SetThreadId(thread_id);
+    if (args_conf_->threadaffinity_ != "none") {
+        utils::PinThread(utils::ThreadCpus(thread_id, args_conf_->threadaffinity_));
+    }
+    // the random stream of this thread, the same for every run
+    utils::Rng rng(args_conf_->seed_, thread_id);
+    // every epoch reads each line of the thread range once, from the
+    // corpus cache shard if there is one
+    bool use_cache = !corpus_cache_.empty();
+    utils::LineReader reader(train_file_, train_ranges_[thread_id].first,
+                             train_ranges_[thread_id].second);
+    utils::Int32Reader cache_reader;
+    if (use_cache) {
+        cache_reader = corpus_reader_[thread_id];
+    }
+    TrainExample example;
+    string_view view;
+    uint32_t line_counter = 0;
+    // the lines this thread trained before the checkpoint it resumes from
+    uint64_t skip = resume_lines_.empty() ? 0 : resume_lines_[thread_id];
+    bool use_checkpoint = args_conf_->UseCheckpoint();
+    // examples of the current turn, the parsing stays parallel
+    const uint32_t turn_size = 1000;
+    uint32_t turn_counter = 0;
+    for (int32_t epoch = 0; epoch < args_conf_->epoch_; epoch++) {
+        reader.Rewind();
+        cache_reader.Rewind();
+        while (true) {
+            if (use_cache) {
+                if (!ReadExample(&cache_reader, &example)) {
+                    break;
+                }
+            } else {
+                if (!reader.Next(&view)) {
+                    break;
+                }
+                if (skip == 0) {
+                    ParseExample(view, &example);
+                }
+            }
+            if (skip > 0) {
+                skip--;
                 continue;
             }
-            string text = parts[3];
-            string text_2 = parts[4];
-            if (text == "" || text_2 == "") continue;
-            pair_model_map_[pair_tag]->UpdatePair(
-                text, text_2, uint32_t(label));
-            if (pair_model_map_[pair_tag]->use_as_skip_example_
-                && args_conf_->useskipgram_) {
-                skip_model_->UpdateSkip(text);
-                skip_model_->UpdateSkip(text_2);
+            if (args_conf_->deterministic_ && turn_counter++ == 0) {
+                WaitTurn(thread_id);
             }
-        }
-        if (thread_id == 0) {
-            if (line_counter >= static_cast<uint32_t>(args_conf_->evalevery_)) {
-                line_counter = 0;
-                PrintEvalInfo(progress, true);
-            } else if (line_counter % args_conf_->getlossevery_ == 0) {
-                PrintEvalInfo(progress, false);
+            line_counter += 1;
+            args_conf_->curlinenum_ += 1;
+            float progress = args_conf_->curlinenum_ /
+                    (args_conf_->totallinenum_ * args_conf_->epoch_ * 1.0);
+            if (line_counter % args_conf_->getlossevery_ == 0) {
+                args_conf_->curlearnrate_ = args_conf_->learnrate_ * (1 - progress);
+            }
+            UpdateExample(example, &rng);
+            thread_lines_[thread_id].fetch_add(1, std::memory_order_relaxed);
+            if (use_checkpoint && line_counter % args_conf_->getlossevery_ == 0) {
+                MaybeCheckpoint();
+            }
+            if (thread_id == 0) {
+                if (line_counter >= static_cast<uint32_t>(args_conf_->evalevery_)) {
+                    line_counter = 0;
+                    if (args_conf_->asynceval_) {
+                        PrintEvalInfo(progress, false);
+                        StartAsyncEval(progress);
+                    } else {
+                        PrintEvalInfo(progress, true);
+                    }
+                } else if (line_counter % args_conf_->getlossevery_ == 0) {
+                    PrintEvalInfo(progress, false);
+                }
+            }
+            if (turn_counter == turn_size) {
+                turn_counter = 0;
+                PassTurn(thread_id, false);
             }
         }
     }
-    fin.close();
-    if (thread_id == 0) {
-        PrintEvalInfo(1, true);
+    if (args_conf_->deterministic_ && turn_counter == 0) {
+        WaitTurn(thread_id);
+    }
+    // the last examples of the cls / pair batches of this thread
+    for (uint32_t i = 0; i < train_models_.size(); i++) {
+        train_models_[i]->FlushBatch();
+    }
+    if (args_conf_->deterministic_) {
+        PassTurn(thread_id, true);
     }
 }
 
 void Embedding::Train() {
+    train_models_.clear();
+    train_model_idx_.clear();
+    for (auto it = cls_model_map_.begin(); it != cls_model_map_.end(); it++) {
+        train_model_idx_["cls\t" + it->first] = int32_t(train_models_.size());
+        train_models_.push_back(it->second);
+    }
+    for (auto it = pair_model_map_.begin(); it != pair_model_map_.end(); it++) {
+        train_model_idx_["pair\t" + it->first] = int32_t(train_models_.size());
+        train_models_.push_back(it->second);
+    }
+    // one epoch reads the text once anyway
+    if (args_conf_->usecorpuscache_ && args_conf_->epoch_ > 1) {
+        CompileCorpus();
+    }
+    // report the cpus of the train threads
+    cerr << "numa nodes: " << utils::GetNumaNodes().size()
+        << " thread affinity: " << args_conf_->threadaffinity_ << endl;
+    if (args_conf_->threadaffinity_ != "none") {
+        for (int32_t i = 0; i < args_conf_->thread_; i++) {
+            cerr << "train thread " << i << " node " << utils::ThreadNode(i)
+                << " cpus " << utils::CpuListStr(
+                    utils::ThreadCpus(i, args_conf_->threadaffinity_)) << endl;
+        }
+    }
+    turn_ = 0;
+    turn_done_.assign(args_conf_->thread_, false);
+    thread_lines_ = vector<atomic<uint64_t>>(args_conf_->thread_);
+    for (int32_t i = 0; i < args_conf_->thread_; i++) {
+        thread_lines_[i] = 0;
+    }
+    if (!resume_lines_.empty()) {
+        if (resume_total_line_num_ != args_conf_->totallinenum_) {
+            cerr << "Warning : the train file changed since the checkpoint, "
+                << "train from its first line" << endl;
+            resume_lines_.clear();
+        } else {
+            // go on with the line counts and learn rate of the checkpoint
+            uint64_t cur_line_num = 0;
+            for (int32_t i = 0; i < args_conf_->thread_; i++) {
+                thread_lines_[i] = resume_lines_[i];
+                cur_line_num += resume_lines_[i];
+            }
+            float progress = cur_line_num /
+                    (args_conf_->totallinenum_ * args_conf_->epoch_ * 1.0);
+            args_conf_->curlinenum_ = cur_line_num;
+            args_conf_->curlearnrate_ = args_conf_->learnrate_ * (1 - progress);
+            cerr << "resume from line " << cur_line_num << " learn rate "
+                << args_conf_->curlearnrate_ << endl;
+        }
+    }
+    if (args_conf_->UseCheckpoint()) {
+        // the checkpoints go into the dir of the final model
+        args_conf_->SetOutputDir();
+        checkpoint_models_.clear();
+        if (skip_model_->HasOutput()) {
+            checkpoint_models_.push_back(skip_model_);
+        }
+        for (uint32_t i = 0; i < train_models_.size(); i++) {
+            checkpoint_models_.push_back(train_models_[i]);
+        }
+        output_snapshots_.resize(checkpoint_models_.size());
+        checkpoint_line_ = args_conf_->curlinenum_;
+        checkpoint_time_ = std::chrono::steady_clock::now();
+    }
+    if (args_conf_->asynceval_) {
+        InitAsyncEval();
+    }
     vector<thread> threads;
     for (int32_t i = 0; i < args_conf_->thread_; i++) {
         threads.push_back(thread([=]() {
@@ -636,12 +1345,157 @@ void Embedding::Train() {
     for (auto it = threads.begin(); it != threads.end(); it++) {
         it->join();
     }
+    WaitCheckpoint();
+    WaitAsyncEval();
+    resume_lines_.clear();
+    // the threads finish their ranges at different times
+    PrintEvalInfo(1, true);
     cerr << endl;
+    for (uint32_t i = 0; i < corpus_cache_.size(); i++) {
+        corpus_cache_[i]->Close();
+    }
+    corpus_cache_.clear();
+    corpus_reader_.clear();
+    corpus_cache_files_.clear();
+}
+
+void Embedding::MaybeCheckpoint() {
+    // one thread checks, the others keep training
+    std::unique_lock<std::mutex> lock(checkpoint_mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+    uint64_t cur_line_num = args_conf_->curlinenum_;
+    bool due = args_conf_->checkpointlines_ > 0
+        && cur_line_num - checkpoint_line_ >= uint64_t(args_conf_->checkpointlines_);
+    if (args_conf_->checkpointminutes_ > 0) {
+        auto minutes = std::chrono::duration_cast<std::chrono::minutes>(
+                std::chrono::steady_clock::now() - checkpoint_time_);
+        due = due || minutes.count() >= args_conf_->checkpointminutes_;
+    }
+    // a checkpoint still being written delays the next one
+    if (!due || checkpoint_busy_) {
+        return;
+    }
+    if (checkpoint_thread_.joinable()) {
+        checkpoint_thread_.join();
+    }
+    // the other threads go on training while the rows are copied
+    vector<uint64_t> thread_lines(thread_lines_.size());
+    for (uint32_t i = 0; i < thread_lines_.size(); i++) {
+        thread_lines[i] = thread_lines_[i].load(std::memory_order_relaxed);
+    }
+    input_layer_->Snapshot(&input_snapshot_);
+    for (uint32_t i = 0; i < checkpoint_models_.size(); i++) {
+        checkpoint_models_[i]->Snapshot(&output_snapshots_[i]);
+    }
+    checkpoint_line_ = cur_line_num;
+    checkpoint_time_ = std::chrono::steady_clock::now();
+    checkpoint_busy_ = true;
+    int32_t num = checkpoint_num_++;
+    checkpoint_thread_ = thread([=]() {
+                WriteCheckpoint(num, cur_line_num, thread_lines);
+                });
 }
 
-void Embedding::SaveMap(map<string, int32_t> &the_map, const string &file) {
+void Embedding::WriteCheckpoint(int32_t num,
+                                uint64_t cur_line_num,
+                                const vector<uint64_t> &thread_lines) {
+    string num_str = "0000" + to_string(num);
+    string dir = args_conf_->outputdir_ + "/checkpoint_"
+        + num_str.substr(num_str.size() - 4, 4);
+    // a half written checkpoint keeps the tmp name
+    string tmp_dir = dir + ".tmp";
+    utils::RemoveDir(tmp_dir);
+    if (!utils::MakeDir(tmp_dir)) {
+        cerr << "Warning : cannot mkdir " << tmp_dir << endl;
+        checkpoint_busy_ = false;
+        return;
+    }
+    SaveMap(cls_tag_map_, tmp_dir, "cls_tag_map_.out");
+    SaveMap(cls_tag_count_map_, tmp_dir, "cls_tag_count_map_.out");
+    SaveMap(pair_tag_map_, tmp_dir, "pair_tag_map_.out");
+    hash_table_->SaveBinary(tmp_dir);
+    input_layer_->SaveSnapshot(tmp_dir, input_snapshot_);
+    for (uint32_t i = 0; i < checkpoint_models_.size(); i++) {
+        checkpoint_models_[i]->SaveSnapshot(tmp_dir, output_snapshots_[i]);
+    }
     ofstream ofs;
-    utils::OpenOutFile(args_conf_->outputdir_, file, ofs);
+    utils::OpenOutFile(tmp_dir, "checkpoint.state", ofs);
+    utils::WriteLine(ofs, "trainfile\t" + args_conf_->trainfile_);
+    utils::WriteLine(ofs, "thread\t" + to_string(args_conf_->thread_));
+    utils::WriteLine(ofs, "epoch\t" + to_string(args_conf_->epoch_));
+    utils::WriteLine(ofs, "totallinenum\t" + to_string(args_conf_->totallinenum_));
+    utils::WriteLine(ofs, "curlinenum\t" + to_string(cur_line_num));
+    string lines = "";
+    for (uint32_t i = 0; i < thread_lines.size(); i++) {
+        lines += (i == 0 ? "" : " ") + to_string(thread_lines[i]);
+    }
+    utils::WriteLine(ofs, "threadlines\t" + lines);
+    utils::CloseOutFile(&ofs);
+
+    utils::RemoveDir(dir);
+    if (rename(tmp_dir.c_str(), dir.c_str()) != 0) {
+        cerr << "Warning : cannot rename " << tmp_dir << " to " << dir << endl;
+        checkpoint_busy_ = false;
+        return;
+    }
+    checkpoint_dirs_.push_back(dir);
+    while (checkpoint_dirs_.size() > uint32_t(args_conf_->checkpointkeep_)) {
+        utils::RemoveDir(checkpoint_dirs_.front());
+        checkpoint_dirs_.erase(checkpoint_dirs_.begin());
+    }
+    checkpoint_busy_ = false;
+}
+
+void Embedding::WaitCheckpoint() {
+    if (checkpoint_thread_.joinable()) {
+        checkpoint_thread_.join();
+    }
+}
+
+bool Embedding::LoadCheckpointState() {
+    string file = args_conf_->modeldir_ + "/checkpoint.state";
+    ifstream fin(file);
+    if (!fin.is_open()) {
+        return false;
+    }
+    // not utils::GetLine, the train file path keeps its case
+    map<string, string> state;
+    string line;
+    while (std::getline(fin, line)) {
+        size_t tab = line.find('\t');
+        if (tab != string::npos) {
+            state[line.substr(0, tab)] = utils::StringTrim(line.substr(tab + 1));
+        }
+    }
+    utils::CloseInFile(&fin);
+    if (state["trainfile"] != args_conf_->trainfile_
+        || state["thread"] != to_string(args_conf_->thread_)
+        || state["epoch"] != to_string(args_conf_->epoch_)) {
+        cerr << "Warning : " << args_conf_->modeldir_ << " is a checkpoint of "
+            << "another trainfile / thread / epoch, train from the first line" << endl;
+        return false;
+    }
+    vector<string> parts;
+    utils::StringSplit(state["threadlines"], " ", parts);
+    if (int32_t(parts.size()) != args_conf_->thread_) {
+        cerr << "Warning : bad checkpoint state " << file << endl;
+        return false;
+    }
+    resume_lines_.assign(parts.size(), 0);
+    for (uint32_t i = 0; i < parts.size(); i++) {
+        resume_lines_[i] = strtoull(parts[i].c_str(), NULL, 10);
+    }
+    resume_total_line_num_ = strtoull(state["totallinenum"].c_str(), NULL, 10);
+    return true;
+}
+
+void Embedding::SaveMap(map<string, int32_t> &the_map,
+                        const string &dir,
+                        const string &file) {
+    ofstream ofs;
+    utils::OpenOutFile(dir, file, ofs);
     for (auto it = the_map.begin(); it != the_map.end(); it++) {
         utils::WriteLine(ofs, it->first + "\t" + to_string(it->second));
     }
@@ -650,9 +1504,9 @@ void Embedding::SaveMap(map<string, int32_t> &the_map, const string &file) {
 
 void Embedding::Save() {
     args_conf_->SetOutputDir();
-    SaveMap(cls_tag_map_, "cls_tag_map_.out");
-    SaveMap(cls_tag_count_map_, "cls_tag_count_map_.out");
-    SaveMap(pair_tag_map_, "pair_tag_map_.out");
+    SaveMap(cls_tag_map_, args_conf_->outputdir_, "cls_tag_map_.out");
+    SaveMap(cls_tag_count_map_, args_conf_->outputdir_, "cls_tag_count_map_.out");
+    SaveMap(pair_tag_map_, args_conf_->outputdir_, "pair_tag_map_.out");
     cerr << "saving skip model ... " << endl;
     skip_model_->Save(true);
     // kb_model_->save(false);
@@ -698,19 +1552,22 @@ void Embedding::Load() {
     LoadMap(cls_tag_count_map_, "cls_tag_count_map_.out");
     LoadMap(pair_tag_map_, "pair_tag_map_.out");
     cerr << "loading hash table ... " << endl;
-    hash_table_ = make_shared<HashTable>(args_conf_,
-                args_conf_->maxvocabsize_ + args_conf_->maxphrasesize_);
+    // only train changes the vocabulary, the other processes look words
+    // up in a frozen table that needs no probe array
+    bool freeze = args_conf_->process_ != "train";
+    hash_table_ = make_shared<HashTable>(args_conf_, freeze ? 0
+                : args_conf_->maxvocabsize_ + args_conf_->maxphrasesize_);
     hash_table_->Load(args_conf_->modeldir_ + "/hashtable.out",
-                args_conf_->freqsample_);
+                args_conf_->freqsample_, freeze);
 
     cerr << "loading input layer ... " << endl;
-    input_layer_ = make_shared<InputLayer>(args_conf_, hash_table_);
+    input_layer_ = make_shared<InputLayer>(args_conf_, hash_table_, false);
     input_layer_->Load();
 
     cerr << "loading skip model ... " << endl;
     skip_model_ = make_shared<Model>(args_conf_, ModelName::skip,
-                hash_table_->wordvec_.size(),
-        input_layer_, "skip", hash_table_);
+                hash_table_->Size(),
+        input_layer_, "skip", hash_table_, false);
     skip_model_->Load(cls_tag_count_map_);
 
     // kb_model_ = make_shared<Model>(args_conf_, ModelName::kb,
@@ -718,7 +1575,7 @@ void Embedding::Load() {
     for (auto it = cls_tag_map_.begin(); it != cls_tag_map_.end(); it++) {
         cerr << "loading cls model " << it->first << " ..." << endl;
         shared_ptr<Model> clsi = make_shared<Model>(args_conf_, ModelName::cls,
-                    it->second + 1, input_layer_, it->first, hash_table_);
+                    it->second + 1, input_layer_, it->first, hash_table_, false);
         // clsi->initNegTable(cls_tag_count_map_);
         clsi->Load(cls_tag_count_map_);
         cls_model_map_[it->first] = clsi;
@@ -726,19 +1583,43 @@ void Embedding::Load() {
     for (auto it = pair_tag_map_.begin(); it != pair_tag_map_.end(); it++) {
         cerr << "loading pair model " << it->first << " ... " << endl;
         shared_ptr<Model> pairi = make_shared<Model>(args_conf_,
-        ModelName::pair, 2, input_layer_, it->first, hash_table_);
+        ModelName::pair, 2, input_layer_, it->first, hash_table_, false);
         pairi->Load(pair_tag_count_map_);
         pair_model_map_[it->first] = pairi;
     }
     cerr << "finished load model" << endl;
 }
 
+void Embedding::Quantize() {
+    LoadEvalExample();
+    cerr << "eval float input layer ... " << endl;
+    PrintEvalInfo(1, true);
+    input_layer_->Quantize();
+    cerr << "eval int8 input layer ... " << endl;
+    PrintEvalInfo(1, true);
+    Save();
+}
+
 void Embedding::MainProcess() {
     if (args_conf_->modeldir_ != "") {
         Load();
     }
     if (args_conf_->process_ == "train") {
-        LoadTrainVocab(args_conf_->modeldir_ != "");
+        if (input_layer_ != NULL && input_layer_->IsQuantized()) {
+            cerr << "Error : can not train a quantized model "
+                << args_conf_->modeldir_ << endl;
+            exit(1);
+        }
+        // with modeldir the loaded model goes on training, from the line
+        // it stopped at if modeldir is a checkpoint of this train file
+        bool resume = args_conf_->modeldir_ != "" && LoadCheckpointState();
+        if (resume) {
+            // the checkpoint counted the tags of this train file already
+            cls_tag_count_map_.clear();
+            pair_tag_count_map_.clear();
+        }
+        LoadTrainVocab(args_conf_->modeldir_ != ""
+                       && (resume || !args_conf_->growvocab_));
         InitModel();
         LoadEvalExample();
         Train();
@@ -752,10 +1633,18 @@ void Embedding::MainProcess() {
             Predict();
         } else if (args_conf_->process_ == "sentence_vec") {
             GetSentenceVec();
+        } else if (args_conf_->process_ == "quantize") {
+            Quantize();
+        } else if (args_conf_->process_ == "convert") {
+            // rewrite the loaded model with the format of modelformat
+            cerr << "converting model to " << args_conf_->modelformat_
+                << " format ... " << endl;
+            Save();
         } else {
             cerr << "error process : " << args_conf_->process_ << endl;
             exit(1);
         }
+        input_layer_->PrintOovInfo();
     }
 }
 }  // end of namespace knowledgeembedding
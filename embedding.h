@@ -6,8 +6,11 @@
 #define KNOWLEDGE_EMBEDDING_EMBEDDING_H
 
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <string>
 #include <utility>
@@ -16,18 +19,62 @@
 #include "model.h"
 
 namespace knowledgeembedding {
+// vocab and tags counted by one thread on its part of the train file
+struct VocabPart {
+    shared_ptr<HashTable> hash_word;
+    shared_ptr<HashTable> hash_phrase;
+    map<string, int32_t> cls_tag_map;
+    // the label of the first example of each cls tag
+    map<string, int32_t> cls_first_label_map;
+    map<string, int32_t> cls_tag_count_map;
+    map<string, int32_t> pair_tag_map;
+    map<string, int32_t> pair_tag_count_map;
+    uint64_t line_counter = 0;
+    uint64_t word_counter = 0;
+    uint64_t phrase_counter = 0;
+};
+
+// one train line mapped to ids, the corpus cache stores these records
+struct TrainExample {
+    // ModelName of the example, 0 if the line is not trained
+    int32_t name = 0;
+    // index of the model in train_models_
+    int32_t model = -1;
+    int32_t label = -1;
+    TextIds text_1;
+    TextIds text_2;
+};
+
+// an eval example of the async eval, the rows are rows of the copy
+struct EvalExample {
+    // ModelName of the example and its model in eval_models_
+    int32_t name = 0;
+    int32_t model = -1;
+    int32_t label = -1;
+    string tag;
+    MergedIdxs rows_1;
+    MergedIdxs rows_2;
+};
+
 class Embedding {
     public:
         Embedding() {}
         ~Embedding() {}
         void InitArgs(const string &confpath);
         // load train file word/phrase vocab
-        void AddVocab(const vector<string> &parts,
-                      const string &text,
+        void AddVocab(const vector<string_view> &parts,
+                      string_view text,
                       HashTable* hash_word,
                       HashTable* hash_phrase,
                       uint64_t &word_counter,
                       uint64_t &phrase_counter);
+        void LoadTrainVocabThread(int32_t thread_id,
+                                  int64_t begin,
+                                  int64_t end,
+                                  bool only_count,
+                                  VocabPart *part);
+        // merge the parts in file order
+        void MergeVocabPart(vector<VocabPart> &parts);
         void LoadTrainVocab(bool only_count);
         // load eval example
         void LoadEvalExample();
@@ -50,18 +97,55 @@ class Embedding {
         float PredictPair(pair<pair<vector<int32_t>, vector<int32_t>>,
                               string> &example);
         void Predict(const string &line, string &res);
+        // predict lines, output gets the result lines
+        void PredictLines(vector<string> &lines, string *output);
         void Predict();
+        // int8 input layer, eval accuracy before and after
+        void Quantize();
         // check model with dev example
         void EvalCls(map<string, pair<int32_t, int32_t>> *result);
         void EvalPair(map<string, pair<int32_t, int32_t>> *result);
         // print eval infos while training
         void PrintEvalInfo(float progress, bool is_eval);
+        // async eval: thread 0 copies the rows of the eval examples and the
+        // cls output layers, a low priority thread scores the copy and
+        // prints the accuracy. an eval still running skips the next one
+        void InitAsyncEval();
+        void StartAsyncEval(float progress);
+        void AsyncEvalThread(float progress, uint32_t size, uint32_t offset);
+        void WaitAsyncEval();
+        // map a train line to ids
+        void ParseExample(string_view raw_line, TrainExample *example);
+        void UpdateExample(const TrainExample &example, utils::Rng *rng);
+        // binary records of the corpus cache
+        void WriteExample(ofstream &ofs, const TrainExample &example);
+        bool ReadExample(utils::Int32Reader *reader, TrainExample *example);
+        // write the examples of the thread range into its cache shard
+        // false if the shard can not be written
+        bool CompileCorpusThread(int32_t thread_id);
+        void CompileCorpus();
+        // turns of the deterministic mode, PassTurn gives the model to the
+        // next thread that is not done
+        void WaitTurn(int32_t thread_id);
+        void PassTurn(int32_t thread_id, bool done);
         // train thread
         void TrainThread(int32_t thread_id);
         // train model
         void Train();
+        // checkpoints of train: a train thread snapshots the model when one
+        // is due, a writer thread saves the copy as outputdir/checkpoint_NNNN
+        void MaybeCheckpoint();
+        void WriteCheckpoint(int32_t num,
+                             uint64_t cur_line_num,
+                             const vector<uint64_t> &thread_lines);
+        void WaitCheckpoint();
+        // the progress of the run modeldir was checkpointed in, false if
+        // modeldir is no checkpoint of the same train file and threads
+        bool LoadCheckpointState();
         // save and load
-        void SaveMap(map<string, int32_t> &the_map, const string &file);
+        void SaveMap(map<string, int32_t> &the_map,
+                     const string &dir,
+                     const string &file);
         void Save();
         void LoadMap(map<string, int32_t> &the_map, const string &file);
         void Load();
@@ -86,6 +170,61 @@ class Embedding {
         vector<pair<pair<vector<int32_t>, vector<int32_t>>, string>> pair_eval_;
 
         string query_type_ = "_all";
+        // lines read by the vocab threads
+        atomic<uint64_t> vocab_line_counter_;
+        // the mapped train file and the line aligned byte range of every
+        // thread, the same ranges are used to count and to train
+        utils::MappedFile train_file_;
+        vector<pair<int64_t, int64_t>> train_ranges_;
+        // the cls and pair models by index, the key is "<type>\t<tag>"
+        vector<shared_ptr<Model>> train_models_;
+        map<string, int32_t> train_model_idx_;
+        // cache shard of every train thread, empty without corpus cache
+        vector<string> corpus_cache_files_;
+        vector<shared_ptr<utils::MappedFile>> corpus_cache_;
+        vector<utils::Int32Reader> corpus_reader_;
+        // the thread that may update the model in deterministic mode
+        std::mutex turn_mutex_;
+        std::condition_variable turn_cv_;
+        int32_t turn_ = 0;
+        vector<bool> turn_done_;
+        // lines trained by every thread, over all epochs
+        vector<atomic<uint64_t>> thread_lines_;
+        // lines every thread skips when train resumes from a checkpoint
+        vector<uint64_t> resume_lines_;
+        uint64_t resume_total_line_num_ = 0;
+        // one thread takes the snapshot, the writer saves it in background
+        std::mutex checkpoint_mutex_;
+        thread checkpoint_thread_;
+        atomic<bool> checkpoint_busy_{false};
+        int32_t checkpoint_num_ = 0;
+        uint64_t checkpoint_line_ = 0;
+        std::chrono::steady_clock::time_point checkpoint_time_;
+        vector<string> checkpoint_dirs_;
+        // the models with an output layer and the copies of their layers
+        vector<shared_ptr<Model>> checkpoint_models_;
+        vector<float> input_snapshot_;
+        vector<vector<float>> output_snapshots_;
+        // async eval: the examples, the input rows they read and the copy
+        // of those rows, the models and the copies of the cls outputs
+        vector<EvalExample> eval_examples_;
+        vector<int32_t> eval_rows_;
+        vector<float> eval_input_;
+        vector<shared_ptr<Model>> eval_models_;
+        vector<vector<float>> eval_outputs_;
+        thread eval_thread_;
+        atomic<bool> eval_busy_{false};
+        // the examples of an eval are spread evenly over the eval set and
+        // shifted by offset from one eval to the next
+        uint32_t eval_offset_ = 0;
+        // the part of the examples that fit an eval takes, halved by every
+        // eval skipped since an eval overran, back to 1 after one in time
+        double eval_backoff_ = 1;
+        bool eval_skipped_ = false;
+        // seconds of one eval example averaged over the evals, the start
+        // of the last eval interval
+        double eval_example_seconds_ = 0;
+        std::chrono::steady_clock::time_point eval_time_;
 }; // Embedding
 } // namespace knowledgeembedding
 #endif // KNOWLEDGE_EMBEDDING_EMBEDDING_H
@@ -4,89 +4,230 @@
  */
 #include "inputlayer.h"
 
+#include <math.h>
+
 namespace knowledgeembedding {
 
 InputLayer::InputLayer(shared_ptr<ArgsConf> args_conf,
-                    shared_ptr<HashTable> hash_table): rng_(1), uniform_(0, 1) {
+                    shared_ptr<HashTable> hash_table,
+                    bool need_init) {
     args_conf_ = args_conf;
     hash_table_ = hash_table;
     col_ = uint32_t(args_conf_->dim_);
-    row_ = uint32_t((hash_table_->wordvec_).size());
+    row_ = hash_table_->Size();
     data_ = NULL;
-    Init();
+    kernels_ = &utils::GetKernels(col_);
+    use_oov_subword_ = args_conf_->UseOovSubword();
+    if (use_oov_subword_ && args_conf_->oovcachesize_ > 0) {
+        oov_cache_ = make_shared<utils::LruCache<vector<int32_t>>>(
+                    args_conf_->oovcachesize_);
+    }
+    if (need_init) {
+        Init();
+    }
 }
 
 InputLayer::~InputLayer() {
-    delete data_;
+    if (mapped_file_ == NULL) {
+        delete[] data_;
+    }
     data_ = NULL;
 }
 
 void InputLayer::Init() {
     uint64_t datasize = uint64_t(row_) * uint64_t(col_);
     data_ = new float[datasize];
-    minstd_rand rng_(1);
+    cerr << "input layer placement: "
+        << utils::PlaceMatrix(data_, row_, col_, args_conf_->numapolicy_,
+                              args_conf_->thread_) << endl;
+    minstd_rand rng(args_conf_->seed_);
     uniform_real_distribution<> init_uniform(-1.0/col_, 1.0/col_);
     for (uint32_t i = 0; i < row_; i++) {
         for (uint32_t j = 0; j < col_; j++) {
             uint64_t idx = uint64_t(i) * uint64_t(col_) + uint64_t(j);
-            data_[idx] = init_uniform(rng_);
+            data_[idx] = init_uniform(rng);
         }
     }
 }
 
-void InputLayer::GetIdxVec(const string &text,
+void InputLayer::Grow(uint32_t row) {
+    if (row <= row_) {
+        return;
+    }
+    assert(!quantized_ && mapped_file_ == NULL);
+    uint64_t old_size = uint64_t(row_) * uint64_t(col_);
+    float *data = new float[uint64_t(row) * uint64_t(col_)];
+    cerr << "input layer placement: "
+        << utils::PlaceMatrix(data, row, col_, args_conf_->numapolicy_,
+                              args_conf_->thread_) << endl;
+    memcpy(data, data_, old_size * sizeof(float));
+    // the new rows start like the rows of Init
+    minstd_rand rng(args_conf_->seed_ + row_);
+    uniform_real_distribution<> init_uniform(-1.0/col_, 1.0/col_);
+    for (uint64_t idx = old_size; idx < uint64_t(row) * uint64_t(col_); idx++) {
+        data[idx] = init_uniform(rng);
+    }
+    cerr << "input layer grows from " << row_ << " to " << row << " rows" << endl;
+    delete[] data_;
+    data_ = data;
+    row_ = row;
+}
+
+void InputLayer::GetIdxVec(string_view text,
                            vector<int32_t> &idx_vec,
+                           utils::Rng *rng,
                            float boost_freq_sample,
                            bool usephrase) {
-    idx_vec.clear();
-    vector<string> word_list;
-    vector<int32_t> word_idx_vec;
-    vector<int32_t> subword_idx_vec;
-    vector<int32_t> phrase_idx_vec;
+    static thread_local TextIds ids;
+    GetTextIds(text, &ids);
+    GetIdxVec(ids, idx_vec, rng, boost_freq_sample, usephrase);
+}
+
+void InputLayer::GetTextIds(string_view text, TextIds *ids) {
+    // per thread buffers, they keep their capacity between examples
+    static thread_local vector<string_view> word_list;
+    static thread_local string ngram_buffer;
+    ids->words.clear();
+    ids->phrases.clear();
+    ids->oov_subwords.clear();
 
     utils::GetSegedWordList(text, word_list);
     if (static_cast<int>(word_list.size()) < args_conf_->minlen_
         || static_cast<int>(word_list.size()) > args_conf_->maxlen_) {
         return;
     }
+    hash_table_->GetWordPos(word_list, ids->words, true);
+    if (use_oov_subword_) {
+        static thread_local vector<int32_t> subwords;
+        for (uint32_t i = 0; i < word_list.size(); i++) {
+            if (ids->words[i] < 0) {
+                GetOovSubwords(word_list[i], subwords);
+                ids->oov_subwords.insert(ids->oov_subwords.end(),
+                            subwords.begin(), subwords.end());
+            }
+        }
+    }
+    if (args_conf_->ngram_ <= 1) {
+        return;
+    }
+    uint32_t ngram = args_conf_->ngram_;
+    ids->phrases.assign(word_list.size() * (ngram - 1), -1);
+    for (uint32_t i = 0; i < word_list.size(); i++) {
+        ngram_buffer.assign(word_list[i]);
+        for (uint32_t j = i+1; j < word_list.size() && j < i+ngram; j++) {
+            ngram_buffer.push_back('_');
+            ngram_buffer.append(word_list[j]);
+            ids->phrases[i * (ngram - 1) + j - i - 1] =
+                hash_table_->GetWordPos(ngram_buffer);
+        }
+    }
+}
 
-    hash_table_->RandomDiscard(&word_list, word_idx_vec, boost_freq_sample);
-    hash_table_->GetSubWordList(word_list, word_idx_vec,subword_idx_vec, args_conf_->subngram_);
-    word_idx_vec.erase(remove_if(word_idx_vec.begin(), word_idx_vec.end(),
-                    [&](int32_t idx){
-                        return idx < 0;
-                    }), word_idx_vec.end());
-    word_idx_vec.shrink_to_fit();
+void InputLayer::GetIdxVec(const TextIds &ids,
+                           vector<int32_t> &idx_vec,
+                           utils::Rng *rng,
+                           float boost_freq_sample,
+                           bool usephrase) {
+    idx_vec.clear();
+    static thread_local vector<int32_t> word_idx_vec;
+    static thread_local vector<int32_t> phrase_idx_vec;
+    if (ids.words.empty()) {
+        return;
+    }
+    word_idx_vec.assign(ids.words.begin(), ids.words.end());
+    if (rng != NULL) {
+        hash_table_->DiscardWordIdx(word_idx_vec, rng, boost_freq_sample);
+    }
 
+    // words, then their subwords, then phrases
+    for (uint32_t i = 0; i < word_idx_vec.size(); i++) {
+        if (word_idx_vec[i] >= 0) {
+            idx_vec.push_back(word_idx_vec[i]);
+        }
+    }
+    for (uint32_t i = 0; i < word_idx_vec.size(); i++) {
+        if (word_idx_vec[i] >= 0) {
+            SubwordSpan subwords = hash_table_->Subwords(word_idx_vec[i]);
+            idx_vec.insert(idx_vec.end(), subwords.begin(), subwords.end());
+        }
+    }
+    idx_vec.insert(idx_vec.end(), ids.oov_subwords.begin(), ids.oov_subwords.end());
     if (usephrase && args_conf_->ngram_ > 1) {
-        vector<string> ngram_list;
-        utils::GetNgramWordList(word_list, ngram_list, args_conf_->ngram_);
-        hash_table_->GetWordPos(ngram_list, phrase_idx_vec);
-        hash_table_->RandomDiscard(&phrase_idx_vec, boost_freq_sample);
+        phrase_idx_vec.clear();
+        for (uint32_t i = 0; i < ids.phrases.size(); i++) {
+            if (ids.phrases[i] >= 0) {
+                phrase_idx_vec.push_back(ids.phrases[i]);
+            }
+        }
+        if (rng != NULL) {
+            hash_table_->RandomDiscard(&phrase_idx_vec, rng, boost_freq_sample);
+        }
+        idx_vec.insert(idx_vec.end(), phrase_idx_vec.begin(), phrase_idx_vec.end());
     }
+}
 
-    idx_vec.insert(idx_vec.end(), word_idx_vec.begin(), word_idx_vec.end());
-    idx_vec.insert(idx_vec.end(), subword_idx_vec.begin(), subword_idx_vec.end());
-    idx_vec.insert(idx_vec.end(), phrase_idx_vec.begin(), phrase_idx_vec.end());
+void InputLayer::GetOovSubwords(string_view word, vector<int32_t> &subwords) {
+    if (oov_cache_ != NULL && oov_cache_->Get(word, &subwords)) {
+        return;
+    }
+    // every char ngram of the word is a string probe of the table
+    hash_table_->GetSubWordList(word, subwords, args_conf_->subngram_);
+    if (oov_cache_ != NULL) {
+        oov_cache_->Put(word, subwords);
+    }
+}
+
+void InputLayer::PrintOovInfo() {
+    if (oov_cache_ == NULL) {
+        return;
+    }
+    uint64_t hits = oov_cache_->Hits();
+    uint64_t lookups = hits + oov_cache_->Misses();
+    cerr << "oov subword cache : lookups " << lookups
+        << "  hit rate " << (lookups > 0 ? 100.0 * hits / lookups : 0) << "%"
+        << "  entries " << oov_cache_->Size() << endl;
 }
 
 void InputLayer::GetLayerByIdxs(int32_t word_idx,
                                 vector<float> &layer,
                                 float rate) {
     assert(layer.size() == col_);
+    GetLayerByIdxs(word_idx, layer.data(), rate);
+}
+void InputLayer::GetLayerByIdxs(const vector<int32_t> &word_idx_vec,
+                                vector<float> &layer,
+                                float boost_freq_sample,
+                                utils::Rng *rng) {
+    assert(layer.size() == col_);
+    GetLayerByIdxs(word_idx_vec, layer.data(), boost_freq_sample, rng);
+}
+void InputLayer::GetLayerByIdxs(int32_t word_idx,
+                                float *layer,
+                                float rate) {
     if (word_idx < 0 || static_cast<uint32_t>(word_idx) >= row_) {
         return;
     }
-    utils::MatrixGetVec(&layer, data_, word_idx, args_conf_->dim_, rate);
+    if (quantized_) {
+        kernels_->axpy_i8(layer, &qdata_[uint64_t(word_idx) * col_],
+                          rate * qscale_[word_idx], col_);
+        return;
+    }
+    kernels_->axpy(layer, utils::RowPtr(data_, word_idx, col_), rate, col_);
 }
 void InputLayer::GetLayerByIdxs(const vector<int32_t> &word_idx_vec,
-                                vector<float> &layer,
+                                float *layer,
                                 float boost_freq_sample,
-                                bool use_discard_rate) {
-    assert(layer.size() == col_);
+                                utils::Rng *rng) {
+    if (rng == NULL) {
+        static thread_local MergedIdxs merged;
+        MergeIdxs(word_idx_vec, &merged);
+        GetLayerByIdxs(merged, layer);
+        return;
+    }
+    // the discard is drawn for every entry, repeated rows stay apart
     float size = static_cast<float>(word_idx_vec.size());
     for (uint32_t i = 0; i < word_idx_vec.size(); i++) {
-        if (use_discard_rate && uniform_(rng_) >
+        if (rng != NULL && rng->Uniform() >
             hash_table_->GetDiscardRate(word_idx_vec[i], boost_freq_sample)) {
             continue;
         }
@@ -94,36 +235,98 @@ void InputLayer::GetLayerByIdxs(const vector<int32_t> &word_idx_vec,
         size++;
     }
     if (size > 1) {
-        for (uint32_t i = 0; i < col_; i++) {
-            layer[i] /= size;
+        kernels_->scale(layer, 1.0 / size, col_);
+    }
+}
+void InputLayer::MergeIdxs(const vector<int32_t> &word_idx_vec,
+                           MergedIdxs *merged) const {
+    // open addressing on the row, a slot keeps the position of the row
+    // in merged, sorting the list costs more than the rows it saves
+    static thread_local vector<int32_t> slots;
+    uint32_t bits = 4;
+    while ((1u << bits) < 2 * word_idx_vec.size()) {
+        bits++;
+    }
+    uint32_t mask = (1u << bits) - 1;
+    slots.assign(mask + 1, -1);
+    merged->rows.clear();
+    merged->size = uint32_t(word_idx_vec.size());
+    for (uint32_t i = 0; i < word_idx_vec.size(); i++) {
+        int32_t idx = word_idx_vec[i];
+        if (idx < 0 || static_cast<uint32_t>(idx) >= row_) {
+            continue;
+        }
+        uint32_t slot = (uint32_t(idx) * 0x9E3779B1u) >> (32 - bits);
+        while (slots[slot] >= 0 && merged->rows[slots[slot]].first != idx) {
+            slot = (slot + 1) & mask;
         }
+        if (slots[slot] >= 0) {
+            merged->rows[slots[slot]].second++;
+        } else {
+            slots[slot] = int32_t(merged->rows.size());
+            merged->rows.push_back(pair<int32_t, int32_t>(idx, 1));
+        }
+    }
+}
+void InputLayer::GetLayerByIdxs(const MergedIdxs &merged, float *layer) {
+    for (uint32_t i = 0; i < merged.rows.size(); i++) {
+        GetLayerByIdxs(merged.rows[i].first, layer, float(merged.rows[i].second));
+    }
+    // the list length plus one for every entry read, as the discard path
+    float size = 2.0f * merged.size;
+    if (size > 1) {
+        kernels_->scale(layer, 1.0 / size, col_);
+    }
+}
+void InputLayer::GetLayerByIdxs(const MergedIdxs &merged,
+                                const float *data,
+                                float *layer) const {
+    for (uint32_t i = 0; i < merged.rows.size(); i++) {
+        kernels_->axpy(layer, utils::RowPtr(data, merged.rows[i].first, col_),
+                       float(merged.rows[i].second), col_);
+    }
+    float size = 2.0f * merged.size;
+    if (size > 1) {
+        kernels_->scale(layer, 1.0 / size, col_);
     }
 }
 
 void InputLayer::UpdateData(int32_t input_idx,
-                            vector<float> &add_vec,
+                            const float *add_vec,
                             float rate) {
     if (static_cast<uint32_t>(input_idx) >= row_) {
         return;
     }
-    utils::MatrixAdd(data_, input_idx, add_vec, args_conf_->dim_, rate);
+    kernels_->axpy(utils::RowPtr(data_, input_idx, col_), add_vec, rate, col_);
 }
 void InputLayer::UpdateData(const vector<int32_t> &input_vec,
-                            vector<float> &add_vec,
+                            const float *add_vec,
                             float rate) {
     if (input_vec.size() <= 0) {
         return;
     }
-    rate = rate / input_vec.size();
-    for (uint32_t i = 0; i < input_vec.size(); i++) {
-        UpdateData(input_vec[i], add_vec, rate);
+    static thread_local MergedIdxs merged;
+    MergeIdxs(input_vec, &merged);
+    UpdateData(merged, add_vec, rate);
+}
+void InputLayer::UpdateData(const MergedIdxs &merged,
+                            const float *add_vec,
+                            float rate) {
+    if (merged.size <= 0) {
+        return;
+    }
+    // a row repeated count times moves once by count times the rate
+    rate = rate / merged.size;
+    for (uint32_t i = 0; i < merged.rows.size(); i++) {
+        UpdateData(merged.rows[i].first, add_vec, rate * merged.rows[i].second);
     }
 }
 
 // get top nearest
 void InputLayer::GetNearestNeighbor(const vector<int32_t> &idx_vec,
                                     priority_queue<pair<float, uint32_t>> &heap,
-                                    const string &query_type) {
+                                    const string &query_type,
+                                    uint32_t top_size) {
     if (idx_vec.size() == 0) {
         return;
     }
@@ -132,18 +335,34 @@ void InputLayer::GetNearestNeighbor(const vector<int32_t> &idx_vec,
         if (idx_vec[i] < 0 || static_cast<uint32_t>(idx_vec[i]) >= row_) {
             continue;
         }
-        for (uint32_t j = 0; j < col_; j++) {
-            uint64_t idx = uint64_t(idx_vec[i]) * uint64_t(col_) + uint64_t(j);
-            query_vec[j] += data_[idx];
-        }
+        utils::MatrixGetVec(&query_vec, data_, idx_vec[i], col_, 1);
     }
     float query_norm = utils::Norm(query_vec);
     query_norm = (abs(query_norm) < 1e-6) ? 1 : query_norm;
+    if (use_ann_) {
+        kernels_->scale(query_vec.data(), 1 / query_norm, col_);
+        vector<pair<float, uint32_t>> result;
+        if (query_type != "_phrase") {
+            word_index_.Search(data_, query_vec.data(), top_size,
+                               args_conf_->annprobe_, result);
+            for (uint32_t i = 0; i < result.size(); i++) {
+                heap.push(result[i]);
+            }
+        }
+        if (query_type != "_word") {
+            phrase_index_.Search(data_, query_vec.data(), top_size,
+                                 args_conf_->annprobe_, result);
+            for (uint32_t i = 0; i < result.size(); i++) {
+                heap.push(result[i]);
+            }
+        }
+        return;
+    }
     for (uint32_t i = 0; i < row_; i++) {
-        if (i >= hash_table_->wordvec_.size()) {
+        if (i >= hash_table_->Size()) {
             break;
         }
-        string word = hash_table_->wordvec_[i].word;
+        string_view word = hash_table_->Word(i);
         if (query_type == "_word" && word.find("_") != string::npos) {
             continue;
         }
@@ -157,7 +376,123 @@ void InputLayer::GetNearestNeighbor(const vector<int32_t> &idx_vec,
     }
 }
 
+void InputLayer::BuildAnnIndex(uint32_t list_num, int32_t thread_num) {
+    vector<uint32_t> word_rows;
+    vector<uint32_t> phrase_rows;
+    uint32_t row = min(row_, hash_table_->Size());
+    for (uint32_t i = 0; i < row; i++) {
+        if (hash_table_->Word(i).find("_") == string::npos) {
+            word_rows.push_back(i);
+        } else {
+            phrase_rows.push_back(i);
+        }
+    }
+    // about sqrt(n) lists keep the centroid and the list scans balanced
+    uint32_t word_list_num = list_num;
+    uint32_t phrase_list_num = list_num;
+    if (list_num == 0) {
+        word_list_num = uint32_t(sqrt(double(word_rows.size()))) + 1;
+        phrase_list_num = uint32_t(sqrt(double(phrase_rows.size()))) + 1;
+    }
+    word_index_.Build(data_, row_, col_, word_rows, word_list_num, thread_num);
+    phrase_index_.Build(data_, row_, col_, phrase_rows, phrase_list_num, thread_num);
+    use_ann_ = true;
+}
+
+void InputLayer::SaveAnnIndex(const string &dir) {
+    word_index_.Save(dir + "/annindex.word");
+    phrase_index_.Save(dir + "/annindex.phrase");
+}
+
+bool InputLayer::LoadAnnIndex(const string &dir) {
+    use_ann_ = word_index_.Load(dir + "/annindex.word", data_, row_, col_)
+        && phrase_index_.Load(dir + "/annindex.phrase", data_, row_, col_);
+    return use_ann_;
+}
+
+void InputLayer::Quantize() {
+    if (quantized_) {
+        return;
+    }
+    uint64_t datasize = uint64_t(row_) * uint64_t(col_);
+    qscale_.assign(row_, 0);
+    qdata_.assign(datasize, 0);
+    for (uint32_t i = 0; i < row_; i++) {
+        const float *src = utils::RowPtr(data_, i, col_);
+        float max_abs = 0;
+        for (uint32_t j = 0; j < col_; j++) {
+            max_abs = max(max_abs, float(fabs(src[j])));
+        }
+        // symmetric [-127, 127], a zero row keeps scale 0
+        float scale = max_abs / 127;
+        qscale_[i] = scale;
+        if (scale <= 0) {
+            continue;
+        }
+        int8_t *dest = &qdata_[uint64_t(i) * col_];
+        for (uint32_t j = 0; j < col_; j++) {
+            dest[j] = int8_t(lrintf(src[j] / scale));
+        }
+    }
+    if (mapped_file_ == NULL) {
+        delete[] data_;
+    }
+    data_ = NULL;
+    mapped_file_.reset();
+    quantized_ = true;
+}
+
+void InputLayer::Dequantize() {
+    if (!quantized_) {
+        return;
+    }
+    uint64_t datasize = uint64_t(row_) * uint64_t(col_);
+    data_ = new float[datasize];
+    for (uint32_t i = 0; i < row_; i++) {
+        float *dest = utils::RowPtr(data_, i, col_);
+        for (uint32_t j = 0; j < col_; j++) {
+            dest[j] = qscale_[i] * qdata_[uint64_t(i) * col_ + j];
+        }
+    }
+    vector<float>().swap(qscale_);
+    vector<int8_t>().swap(qdata_);
+    quantized_ = false;
+}
+
 void InputLayer::Save() {
+    if (quantized_) {
+        // binary whatever modelformat is, text would not be smaller
+        utils::WriteBinaryInt8Matrix(args_conf_->outputdir_, "layer.input.q8",
+                                     qscale_.data(), qdata_.data(), row_, col_);
+        return;
+    }
+    if (args_conf_->modelformat_ == "text") {
+        SaveText();
+        return;
+    }
+    utils::WriteBinaryMatrix(args_conf_->outputdir_, "layer.input",
+                             data_, row_, col_);
+}
+
+void InputLayer::Snapshot(vector<float> *data) const {
+    assert(!quantized_);
+    data->assign(data_, data_ + uint64_t(row_) * uint64_t(col_));
+}
+
+void InputLayer::SnapshotRows(const vector<int32_t> &rows, vector<float> *data) const {
+    assert(!quantized_);
+    data->resize(uint64_t(rows.size()) * col_);
+    for (uint32_t i = 0; i < rows.size(); i++) {
+        memcpy(utils::RowPtr(data->data(), i, col_), utils::RowPtr(data_, rows[i], col_),
+               col_ * sizeof(float));
+    }
+}
+
+void InputLayer::SaveSnapshot(const string &dir, const vector<float> &data) {
+    utils::WriteBinaryMatrix(dir, "layer.input", data.data(), row_, col_);
+}
+
+void InputLayer::SaveText() {
     ofstream ofs;
     utils::OpenOutFile(args_conf_->outputdir_, "layer.input", ofs);
     utils::WriteLine(ofs, to_string(row_));
@@ -176,6 +511,35 @@ void InputLayer::Save() {
 
 void InputLayer::Load() {
     string input_layer_file = args_conf_->modeldir_ + "/layer.input";
+    if (mapped_file_ == NULL) {
+        delete[] data_;
+    }
+    data_ = NULL;
+    mapped_file_.reset();
+    quantized_ = false;
+    // a quantized model dir has layer.input.q8 instead of layer.input
+    struct stat st;
+    string quantized_file = input_layer_file + ".q8";
+    if (stat(quantized_file.c_str(), &st) == 0) {
+        utils::ReadBinaryInt8Matrix(quantized_file, &qscale_, &qdata_, &row_, &col_);
+        quantized_ = true;
+        kernels_ = &utils::GetKernels(col_);
+        return;
+    }
+    bool is_binary = utils::IsBinaryFile(input_layer_file);
+    if (is_binary && args_conf_->UseMmapLoad()) {
+        mapped_file_ = make_shared<utils::MappedFile>();
+        utils::MapBinaryMatrix(input_layer_file, mapped_file_.get(),
+                               &data_, &row_, &col_);
+    } else if (is_binary) {
+        utils::ReadBinaryMatrix(input_layer_file, &data_, &row_, &col_);
+    } else {
+        LoadText(input_layer_file);
+    }
+    kernels_ = &utils::GetKernels(col_);
+}
+
+void InputLayer::LoadText(const string &input_layer_file) {
     ifstream fin(input_layer_file);
     assert(fin.is_open());
 
@@ -192,7 +556,7 @@ void InputLayer::Load() {
     assert(col_ > 0);
 
     uint32_t count = 0;
-    uint64_t datasize = row_ * col_;
+    uint64_t datasize = uint64_t(row_) * uint64_t(col_);
     data_ = new float[datasize];
     vector<float> vec_num;
     while (utils::GetLine(fin, line)) {
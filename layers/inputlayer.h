@@ -12,23 +12,68 @@
 #include <vector>
 
 #include "../utils/basicutil.h"
+#include "../utils/binaryutil.h"
 #include "../utils/hashtable.h"
+#include "../utils/ivfindex.h"
+#include "../utils/lrucache.h"
 #include "../utils/matrixutil.h"
+#include "../utils/numautil.h"
 #include "../utils/textutil.h"
 #include "../utils/vectorutil.h"
 
 namespace knowledgeembedding {
+// a text mapped to hash table positions, the random discard of the
+// train epochs works on these positions without any string work
+struct TextIds {
+    // position of every word, -1 if the word is not in vocab
+    vector<int32_t> words;
+    // position of the ngram of n (2 <= n <= ngram) words starting at
+    // word i is phrases[i * (ngram - 1) + n - 2], -1 if not in vocab
+    vector<int32_t> phrases;
+    // subwords of the out of vocab words, only filled with oovsubword
+    vector<int32_t> oov_subwords;
+};
+
+// an index list with its repeated rows merged, every row is read or
+// written once with its count as the rate
+struct MergedIdxs {
+    // (row, count) in first seen order, out of range indexes are dropped
+    vector<pair<int32_t, int32_t>> rows;
+    // length of the index list, the average divides by it
+    uint32_t size = 0;
+};
+
 class InputLayer {
     public:
         InputLayer(shared_ptr<ArgsConf> args_conf,
-                shared_ptr<HashTable> hash_table);
+                shared_ptr<HashTable> hash_table,
+                bool need_init = true);
         ~InputLayer();
         void Init();
-        // get index vector from text
-        void GetIdxVec(const string &text,
+        // continued training: append random rows up to row, the loaded
+        // rows stay as they are
+        void Grow(uint32_t row);
+        // get index vector from text, the frequent words and phrases
+        // are randomly discarded with the rng of a train thread,
+        // predict passes no rng and keeps all of them
+        void GetIdxVec(string_view text,
                        vector<int32_t> &idx_vec,
+                       utils::Rng *rng = NULL,
                        float boost_freq_sample = 10000,
                        bool usephrase = true);
+        // map text to positions, words stays empty if the word number
+        // is out of [minlen, maxlen]
+        void GetTextIds(string_view text, TextIds *ids);
+        void GetIdxVec(const TextIds &ids,
+                       vector<int32_t> &idx_vec,
+                       utils::Rng *rng = NULL,
+                       float boost_freq_sample = 10000,
+                       bool usephrase = true);
+        // subwords of an out of vocab word, through the lru cache
+        void GetOovSubwords(string_view word, vector<int32_t> &subwords);
+        bool UseOovSubword() const { return use_oov_subword_; }
+        // hit rate of the oov subword cache
+        void PrintOovInfo();
         // get vector from data
         void GetLayerByIdxs(int32_t word_idx,
                             vector<float> &layer,
@@ -36,33 +81,85 @@ class InputLayer {
         void GetLayerByIdxs(const vector<int32_t> &word_idx_vec,
                             vector<float> &layer,
                             float boost_freq_sample,
-                            bool use_discard_rate = false);
+                            utils::Rng *rng = NULL);
+        // layer points to col_ floats
+        void GetLayerByIdxs(int32_t word_idx,
+                            float *layer,
+                            float rate = 1.0);
+        void GetLayerByIdxs(const vector<int32_t> &word_idx_vec,
+                            float *layer,
+                            float boost_freq_sample,
+                            utils::Rng *rng = NULL);
+        // same as the list without discard, a caller that reads and
+        // updates the same list merges it once
+        void MergeIdxs(const vector<int32_t> &word_idx_vec, MergedIdxs *merged) const;
+        void GetLayerByIdxs(const MergedIdxs &merged, float *layer);
+        // the rows of merged are rows of data, a copy of SnapshotRows
+        void GetLayerByIdxs(const MergedIdxs &merged, const float *data, float *layer) const;
         // update word vector data
         void UpdateData(int32_t input_idx,
-                        vector<float> &add_vec,
+                        const float *add_vec,
                         float rate = 1);
         void UpdateData(const vector<int32_t> &input_vec,
-                        vector<float> &add_vec,
+                        const float *add_vec,
+                        float rate = 1);
+        void UpdateData(const MergedIdxs &merged,
+                        const float *add_vec,
                         float rate = 1);
-        // get top nearest
+        // get top nearest, with an ann index only the top_size best
+        // rows of the query type are pushed into heap
         void GetNearestNeighbor(const vector<int32_t> &idx_vec,
                                 priority_queue<pair<float, uint32_t>> &heap,
-                                const string &query_type);
+                                const string &query_type,
+                                uint32_t top_size = 20);
+        // ann index of the word rows and of the phrase rows
+        void BuildAnnIndex(uint32_t list_num, int32_t thread_num);
+        void SaveAnnIndex(const string &dir);
+        // return false if the index files are missing or stale
+        bool LoadAnnIndex(const string &dir);
+        // int8 rows with a float scale per row, GetLayerByIdxs reads them
+        // directly, the quantized layer can not be trained
+        void Quantize();
+        void Dequantize();
+        bool IsQuantized() const { return quantized_; }
         // write data
         void Save();
         void Load();
+        // checkpoints: copy the rows while training goes on, and write
+        // such a copy in binary as the saved layer
+        void Snapshot(vector<float> *data) const;
+        // copy of the given rows only, row i of data is rows[i]
+        void SnapshotRows(const vector<int32_t> &rows, vector<float> *data) const;
+        void SaveSnapshot(const string &dir, const vector<float> &data);
 
     public:
         float* data_;
 
+    private:
+        void SaveText();
+        void LoadText(const string &input_layer_file);
+
     private:
         shared_ptr<HashTable> hash_table_;
         shared_ptr<ArgsConf> args_conf_;
+        // not NULL when data_ points into a read-only mapping
+        shared_ptr<utils::MappedFile> mapped_file_;
         uint32_t row_ = 0;
         uint32_t col_ = 0;
-
-        minstd_rand rng_;
-        uniform_real_distribution<> uniform_;
+        // the quantized layer replaces data_
+        bool quantized_ = false;
+        vector<float> qscale_;
+        vector<int8_t> qdata_;
+        // phrases hold a "_", the other rows are words and subwords
+        utils::IvfIndex word_index_;
+        utils::IvfIndex phrase_index_;
+        bool use_ann_ = false;
+        // word -> subword list of recent out of vocab words, NULL if
+        // oovsubword is off or the cache size is 0
+        bool use_oov_subword_ = false;
+        shared_ptr<utils::LruCache<vector<int32_t>>> oov_cache_;
+        // kernels unrolled for col_
+        const utils::Kernels *kernels_;
 }; // InputLayer
 } // namespace knowledgeembedding
 
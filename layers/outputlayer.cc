@@ -10,24 +10,32 @@ OutputLayer::OutputLayer(shared_ptr<HashTable> hash_table,
                         shared_ptr<ArgsConf> args_conf,
                         ModelName n,
                         int cls_number,
-                        const string &tag): name_(n), class_tag_(tag) {
+                        const string &tag,
+                        bool need_init): name_(n), class_tag_(tag) {
     assert(cls_number > 1);
     hash_table_ = hash_table;
     args_conf_ = args_conf;
     row_ = uint32_t(cls_number);
     col_ = args_conf_->dim_;
     data_ = NULL;
-    Init();
+    if (need_init) {
+        Init();
+    }
 }
 
 OutputLayer::~OutputLayer() {
-    delete data_;
+    if (mapped_file_ == NULL) {
+        delete[] data_;
+    }
     data_ = NULL;
 }
 
 void OutputLayer::Init() {
     uint64_t datasize = uint64_t(row_) * uint64_t(col_);
     data_ = new float[datasize];
+    cerr << GetFileName() << " placement: "
+        << utils::PlaceMatrix(data_, row_, col_, args_conf_->numapolicy_,
+                              args_conf_->thread_) << endl;
     for (uint32_t i = 0; i < row_; i++) {
         for (uint32_t j = 0; j < col_; j++) {
             uint64_t idx = uint64_t(i) * uint64_t(col_) + uint64_t(j);
@@ -36,10 +44,49 @@ void OutputLayer::Init() {
     }
 }
 
+void OutputLayer::Grow(uint32_t row) {
+    if (row <= row_) {
+        return;
+    }
+    assert(mapped_file_ == NULL);
+    uint64_t old_size = uint64_t(row_) * uint64_t(col_);
+    float *data = new float[uint64_t(row) * uint64_t(col_)];
+    cerr << GetFileName() << " placement: "
+        << utils::PlaceMatrix(data, row, col_, args_conf_->numapolicy_,
+                              args_conf_->thread_) << endl;
+    memcpy(data, data_, old_size * sizeof(float));
+    memset(data + old_size, 0, (uint64_t(row) * uint64_t(col_) - old_size) * sizeof(float));
+    delete[] data_;
+    data_ = data;
+    row_ = row;
+}
+
+string OutputLayer::GetFileName() {
+    return "layer.output." + to_string(static_cast<int>(name_)) + "." + class_tag_;
+}
+
 void OutputLayer::Save() {
+    if (args_conf_->modelformat_ == "text") {
+        SaveText();
+        return;
+    }
+    utils::WriteBinaryMatrix(args_conf_->outputdir_, GetFileName(),
+                             data_, row_, col_);
+    SaveTree(args_conf_->outputdir_);
+}
+
+void OutputLayer::Snapshot(vector<float> *data) const {
+    data->assign(data_, data_ + uint64_t(row_) * uint64_t(col_));
+}
+
+void OutputLayer::SaveSnapshot(const string &dir, const vector<float> &data) {
+    utils::WriteBinaryMatrix(dir, GetFileName(), data.data(), row_, col_);
+    SaveTree(dir);
+}
+
+void OutputLayer::SaveText() {
     ofstream ofs;
-    utils::OpenOutFile(args_conf_->outputdir_, "layer.output."
-                + to_string(static_cast<int>(name_)) + "." + class_tag_, ofs);
+    utils::OpenOutFile(args_conf_->outputdir_, GetFileName(), ofs);
     utils::WriteLine(ofs, to_string(row_));
     utils::WriteLine(ofs, to_string(col_));
     for (uint32_t i = 0; i < row_; i++) {
@@ -52,11 +99,30 @@ void OutputLayer::Save() {
         utils::WriteLine(ofs, line);
     }
     utils::CloseOutFile(&ofs);
+    SaveTree(args_conf_->outputdir_);
 }
 
 void OutputLayer::Load() {
-    string output_layer_file = args_conf_->modeldir_ + "/layer.output."
-                            + to_string(static_cast<int>(name_)) + "." + class_tag_;
+    string output_layer_file = args_conf_->modeldir_ + "/" + GetFileName();
+    if (mapped_file_ == NULL) {
+        delete[] data_;
+    }
+    data_ = NULL;
+    mapped_file_.reset();
+    bool is_binary = utils::IsBinaryFile(output_layer_file);
+    if (is_binary && args_conf_->UseMmapLoad()) {
+        mapped_file_ = make_shared<utils::MappedFile>();
+        utils::MapBinaryMatrix(output_layer_file, mapped_file_.get(),
+                               &data_, &row_, &col_);
+    } else if (is_binary) {
+        utils::ReadBinaryMatrix(output_layer_file, &data_, &row_, &col_);
+    } else {
+        LoadText(output_layer_file);
+    }
+    LoadTree();
+}
+
+void OutputLayer::LoadText(const string &output_layer_file) {
     ifstream fin(output_layer_file);
     assert(fin.is_open());
     string line;
@@ -67,7 +133,7 @@ void OutputLayer::Load() {
     assert(utils::StringToNumber(line, &col_));
 
     uint32_t count = 0;
-    uint64_t datasize = row_ * col_;
+    uint64_t datasize = uint64_t(row_) * uint64_t(col_);
     data_ = new float[datasize];
     vector<float> vec_num;
     while (utils::GetLine(fin, line)) {
@@ -95,4 +161,79 @@ void OutputLayer::Load() {
     }
     utils::CloseInFile(&fin);
 }
+
+void OutputLayer::BuildTree(const vector<int64_t> &counts) {
+    assert(counts.size() == row_);
+    // node i < row_ is leaf i, node row_ + k is inner node k
+    vector<int32_t> parent(2 * row_ - 1, -1);
+    vector<bool> binary(2 * row_ - 1, false);
+    children_.clear();
+    typedef pair<int64_t, int32_t> CountNode;
+    priority_queue<CountNode, vector<CountNode>, std::greater<CountNode>> heap;
+    for (uint32_t i = 0; i < row_; i++) {
+        heap.push(CountNode(counts[i], int32_t(i)));
+    }
+    while (heap.size() > 1) {
+        CountNode left = heap.top();
+        heap.pop();
+        CountNode right = heap.top();
+        heap.pop();
+        int32_t node = int32_t(row_ + children_.size());
+        children_.push_back(make_pair(left.second, right.second));
+        parent[left.second] = node;
+        parent[right.second] = node;
+        binary[right.second] = true;
+        heap.push(CountNode(left.first + right.first, node));
+    }
+    paths_.assign(row_, vector<int32_t>());
+    codes_.assign(row_, vector<bool>());
+    for (uint32_t i = 0; i < row_; i++) {
+        int32_t node = int32_t(i);
+        while (parent[node] >= 0) {
+            paths_[i].push_back(parent[node] - int32_t(row_));
+            codes_[i].push_back(binary[node]);
+            node = parent[node];
+        }
+    }
+    counts_ = counts;
+}
+
+string OutputLayer::GetTreeFileName() {
+    return GetFileName() + ".hs";
+}
+
+void OutputLayer::SaveTree(const string &dir) {
+    if (!HasTree()) {
+        return;
+    }
+    ofstream ofs;
+    utils::OpenOutFile(dir, GetTreeFileName(), ofs);
+    utils::WriteLine(ofs, to_string(row_));
+    for (uint32_t i = 0; i < counts_.size(); i++) {
+        utils::WriteLine(ofs, to_string(counts_[i]));
+    }
+    utils::CloseOutFile(&ofs);
+}
+
+void OutputLayer::LoadTree() {
+    ifstream fin(args_conf_->modeldir_ + "/" + GetTreeFileName());
+    if (!fin.is_open()) {
+        return;
+    }
+    string line;
+    uint32_t size = 0;
+    utils::GetLine(fin, line);
+    assert(utils::StringToNumber(line, &size));
+    assert(size == row_);
+    vector<int64_t> counts;
+    while (utils::GetLine(fin, line)) {
+        utils::StringTrim(&line);
+        if (line == "") continue;
+        int64_t count = 0;
+        assert(utils::StringToNumber(line, &count));
+        counts.push_back(count);
+    }
+    utils::CloseInFile(&fin);
+    BuildTree(counts);
+}
 } // namespace knowledgeembedding
@@ -5,12 +5,17 @@
 #ifndef KNOWLEDGE_EMBEDDING_LAYERS_OUTPUTLAYER_H
 #define KNOWLEDGE_EMBEDDING_LAYERS_OUTPUTLAYER_H
 
+#include <functional>
 #include <map>
+#include <queue>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "../utils/basicutil.h"
+#include "../utils/binaryutil.h"
 #include "../utils/hashtable.h"
+#include "../utils/numautil.h"
 #include "../utils/vectorutil.h"
 
 namespace knowledgeembedding {
@@ -20,23 +25,52 @@ class OutputLayer {
                     shared_ptr<ArgsConf> args_conf,
                     ModelName n,
                     int cls_number,
-                    const string &tag);
+                    const string &tag,
+                    bool need_init = true);
         ~OutputLayer();
         void Init();
+        // continued training: append zero rows up to row
+        void Grow(uint32_t row);
         // save and load
         void Save();
         void Load();
+        // checkpoints: copy the rows while training goes on, and write
+        // such a copy in binary as the saved layer
+        void Snapshot(vector<float> *data) const;
+        void SaveSnapshot(const string &dir, const vector<float> &data);
+        // build the huffman tree of the hs loss from the label counts,
+        // label i is leaf i and inner node k uses row k - row_ of data_
+        void BuildTree(const vector<int64_t> &counts);
+        bool HasTree() { return !paths_.empty(); }
 
     public:
         float* data_;
         uint32_t row_;
         uint32_t col_;
+        // inner nodes (as data_ rows) from the leaf of each label to the
+        // root and the branch taken at each of them
+        vector<vector<int32_t>> paths_;
+        vector<vector<bool>> codes_;
+        // left / right child of each inner node, the root is the last one
+        vector<pair<int32_t, int32_t>> children_;
+
+    private:
+        string GetFileName();
+        string GetTreeFileName();
+        void SaveText();
+        void LoadText(const string &output_layer_file);
+        void SaveTree(const string &dir);
+        void LoadTree();
 
     private:
         shared_ptr<HashTable> hash_table_;
         shared_ptr<ArgsConf> args_conf_;
+        // not NULL when data_ points into a read-only mapping
+        shared_ptr<utils::MappedFile> mapped_file_;
         ModelName name_;
         string class_tag_;
+        // label counts of the huffman tree
+        vector<int64_t> counts_;
 }; // OutputLayer
 } // namespace knowledgeembedding
 
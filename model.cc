@@ -5,28 +5,41 @@
 #include "model.h"
 
 namespace knowledgeembedding {
+namespace {
+// the counters have a single writer, a relaxed load and store is enough
+template<typename T>
+inline void RelaxedAdd(atomic<T> *counter, T value) {
+    counter->store(counter->load(std::memory_order_relaxed) + value,
+                   std::memory_order_relaxed);
+}
+} // namespace
+
+thread_local int32_t Model::thread_id_ = 0;
 
 Model::Model(shared_ptr<ArgsConf> args_conf,
              ModelName n,
              int32_t cls_number,
              shared_ptr<InputLayer> input_layer,
              const string &tag,
-             shared_ptr<HashTable> hash_table):
+             shared_ptr<HashTable> hash_table,
+             bool need_init):
     args_conf_(args_conf),
     name_(n),
     loss_fun_(LossFun::ng),
     cls_number_(cls_number),
     class_tag_(tag),
-    rng_(static_cast<int>(n) + cls_number),
-    uniform_(0, 1) {
+    thread_stats_(max(args_conf->thread_, 1)),
+    thread_batches_(max(args_conf->thread_, 1)),
+    last_time_(std::chrono::steady_clock::now()) {
     hash_table_ = hash_table;
     input_layer_ = input_layer;
-    output_layer_ = make_shared<OutputLayer>(hash_table, args_conf, n, cls_number, tag);
+    output_layer_ = make_shared<OutputLayer>(hash_table, args_conf, n,
+                                             cls_number, tag, need_init);
     Init();
 }
 Model::~Model() {
     delete sigmoid_table_;
-    neg_table_.clear();
+    neg_table_.Clear();
 }
 
 void Model::Init() {
@@ -40,8 +53,13 @@ void Model::Init() {
         use_as_skip_example_ = args_conf_->GetParamStr(
                     "cls_" + class_tag_ + "_use_as_skip_example") == "true" ?
                     true : false;
-        if (args_conf_->GetParamStr("cls_" + class_tag_ + "_loss") == "softmax") {
+        val = args_conf_->GetParamNum("cls_" + class_tag_ + "_batch");
+        batch_size_ = val >= 1 ? uint32_t(val) : 1;
+        string loss = args_conf_->GetParamStr("cls_" + class_tag_ + "_loss");
+        if (loss == "softmax") {
             loss_fun_ = LossFun::softmax;
+        } else if (loss == "hs") {
+            loss_fun_ = LossFun::hs;
         }
     } else if (name_ ==  ModelName::pair) {
         float val = args_conf_->GetParamNum("pair_" + class_tag_ + "_boost");
@@ -51,6 +69,8 @@ void Model::Init() {
         use_as_skip_example_ = args_conf_->GetParamStr(
                     "pair_" + class_tag_ + "_use_as_skip_example") == "true" ?
                     true : false;
+        val = args_conf_->GetParamNum("pair_" + class_tag_ + "_batch");
+        batch_size_ = val >= 1 ? uint32_t(val) : 1;
     } else if (name_ == ModelName::skip) {
         float val = args_conf_->GetParamNum("skipgram_boost");
         boost_ = val >= 0 ? val : 1.0;
@@ -64,7 +84,8 @@ void Model::Init() {
     cerr << "---------------- model " << name_str
         << " " << class_tag_ << " params ------------------\n"
         << std::left << setw(30) << "loss: "
-        << (loss_fun_ == LossFun::softmax ? "softmax" : "ng") << "\n"
+        << (loss_fun_ == LossFun::softmax ? "softmax" :
+            (loss_fun_ == LossFun::hs ? "hs" : "ng")) << "\n"
         << std::left << setw(30) << "cls_number_:" << cls_number_ << "\n"
         << std::left << setw(30) << "boost_:" << boost_ << "\n"
         << std::left << setw(30) << "boost_freq_sample_:"
@@ -74,71 +95,75 @@ void Model::Init() {
     if (name_ == ModelName::cls || name_ == ModelName::pair) {
         cerr << std::left << setw(30) << "use_as_skip_example_:"
             << (use_as_skip_example_ ? "true" : "false") << endl;
+        cerr << std::left << setw(30) << "batch_size_:" << batch_size_ << endl;
+        if (name_ == ModelName::cls && batch_size_ > 1
+            && loss_fun_ != LossFun::softmax) {
+            cerr << "cls " << class_tag_ << " batch needs the softmax loss, "
+                << "train example by example" << endl;
+        }
     }
     InitSigmoid();
     InitLog();
+    kernels_ = &utils::GetKernels(args_conf_->dim_);
+    switch (args_conf_->dim_) {
+        case 64: BindDim<64>(); break;
+        case 128: BindDim<128>(); break;
+        case 256: BindDim<256>(); break;
+        default: BindDim<0>(); break;
+    }
+}
+
+template<uint32_t DIM>
+void Model::BindDim() {
+    update_skip_ = &Model::UpdateSkipDim<DIM>;
+    update_cls_ = &Model::UpdateClsDim<DIM>;
+    update_pair_ = &Model::UpdatePairDim<DIM>;
+    predict_pair_ = &Model::PredictPairDim<DIM>;
+    predict_cls_ = &Model::PredictClsDim<DIM>;
+    predict_cls_score_ = &Model::PredictClsScoreDim<DIM>;
 }
 
-void Model::RandomMask(vector<float> &mask_vec) {
+void Model::RandomMask(float *mask_vec, utils::Rng *rng) {
     assert(args_conf_->dropoutkeeprate_ > 0);
     assert(args_conf_->dropoutkeeprate_ <= 1);
-    assert(mask_vec.size() == args_conf_->dim_);
-    for (uint32_t i = 0; i < mask_vec.size(); i++) {
-        float r = uniform_(rng_);
+    uint32_t dim = args_conf_->dim_;
+    for (uint32_t i = 0; i < dim; i++) {
+        float r = rng->Uniform();
         mask_vec[i] = r < args_conf_->dropoutkeeprate_ ? 1 / args_conf_->dropoutkeeprate_ : 0;
     }
     // utils::Print(mask_vec);
     // exit(1);
 }
 
-float Model::GetRandFloat(float min, float max) {
+float Model::GetRandFloat(float min, float max, utils::Rng *rng) {
     assert(max > min);
-    float r = uniform_(rng_);
+    float r = rng->Uniform();
     r = r * (max - min) + min;
     return r;
 }
 
-int32_t Model::GetRandInt(int32_t min, int32_t max) {
-    if (min >= max) {
-        return min;
-    }
-    rand_long_ = rand_long_ * (static_cast<uint64_t>(25214903917)) + 11;
-    return (rand_long_ >> 16) % (max - min + 1) + min;
+int32_t Model::GetRandInt(int32_t min, int32_t max, utils::Rng *rng) {
+    return rng->Int(min, max);
 }
 
 void Model::InitNegTable() {
-    float sum = 0;
-    for (uint32_t i = 0; i < hash_table_->wordvec_.size(); i++) {
-        // only use seged word (no subword or ngramstr)
-        if (hash_table_->wordvec_[i].subwords.size() <= 0) {
-            continue;
-        }
-        sum += pow(hash_table_->wordvec_[i].freq, 0.5);
-    }
-    for (uint32_t i = 0; i < hash_table_->wordvec_.size(); i++) {
+    vector<uint32_t> values;
+    vector<double> weights;
+    for (uint32_t i = 0; i < hash_table_->Size(); i++) {
         // only use seged word (no subword or ngramstr)
-        if (hash_table_->wordvec_[i].subwords.size() <= 0) {
+        if (hash_table_->Subwords(i).empty()) {
             continue;
         }
-        float c = pow(hash_table_->wordvec_[i].freq, 0.5);
-        for (uint32_t j = 0; j < c * NEG_TABLE_SIZE / sum; j++) {
-            neg_table_.push_back(i);
-        }
+        values.push_back(i);
+        weights.push_back(pow(hash_table_->Freq(i), 0.5));
     }
-    shuffle(neg_table_.begin(), neg_table_.end(), rng_);
+    neg_table_.Build(values, weights);
 }
 void Model::InitNegTable(const map<string, int32_t> &tag_count_map) {
     cerr << "init neg table with map.size: " << tag_count_map.size() << endl;
     vector<string> parts;
-    float sum = 0;
-    for (auto it = tag_count_map.begin(); it != tag_count_map.end(); it++) {
-        utils::StringSplit(it->first, "\t", parts);
-        string tag = parts[0];
-        if (tag == class_tag_) {
-            sum += pow(it->second, 0.5);
-        }
-    }
-    assert(sum > 0);
+    vector<uint32_t> values;
+    vector<double> weights;
     for (auto it = tag_count_map.begin(); it != tag_count_map.end(); it++) {
         utils::StringSplit(it->first, "\t", parts);
         if (parts.size() != 2) {
@@ -153,33 +178,52 @@ void Model::InitNegTable(const map<string, int32_t> &tag_count_map) {
             continue;
         }
         if (tag == class_tag_) {
-            float num = pow(it->second, 0.5);
-            for (int32_t i = 0; i < (num * NEG_TABLE_SIZE / sum); i++) {
-                neg_table_.push_back(uint32_t(label));
-            }
+            values.push_back(uint32_t(label));
+            weights.push_back(pow(it->second, 0.5));
         }
     }
-    shuffle(neg_table_.begin(), neg_table_.end(), rng_);
+    neg_table_.Build(values, weights);
+    assert(!neg_table_.Empty());
 }
 
-uint32_t Model::GetNegativeLabel(uint32_t positive_label) {
+void Model::InitTree(const map<string, int32_t> &tag_count_map) {
+    if (loss_fun_ != LossFun::hs) {
+        return;
+    }
+    vector<int64_t> counts(output_layer_->row_, 0);
+    vector<string> parts;
+    for (auto it = tag_count_map.begin(); it != tag_count_map.end(); it++) {
+        utils::StringSplit(it->first, "\t", parts);
+        if (parts.size() != 2 || parts[0] != class_tag_) {
+            continue;
+        }
+        uint32_t label = 0;
+        if (!utils::StringToNumber(parts[1], &label)
+            || label >= counts.size()) {
+            continue;
+        }
+        counts[label] = it->second;
+    }
+    output_layer_->BuildTree(counts);
+}
+
+uint32_t Model::GetNegativeLabel(uint32_t positive_label, utils::Rng *rng) {
     uint32_t neg_label = positive_label;
     do {
-        neg_table_index_ = (neg_table_index_ + 1) % neg_table_.size();
-        neg_label = neg_table_[neg_table_index_];
+        neg_label = neg_table_.Sample(rng);
     } while (neg_label == positive_label);
     return neg_label;
 }
 
-uint32_t Model::GetNegativeLabel(const map<uint32_t, uint32_t> &pos_counter,
+uint32_t Model::GetNegativeLabel(const vector<uint32_t> &positives,
+                                 utils::Rng *rng,
                                  uint32_t max_find_times) {
     uint32_t neg_label = 0;
     uint32_t find_times = 0;
     do {
-        neg_table_index_ = (neg_table_index_ + 1) % neg_table_.size();
-        neg_label = neg_table_[neg_table_index_];
+        neg_label = neg_table_.Sample(rng);
         find_times++;
-    } while (pos_counter.find(neg_label) != pos_counter.end()
+    } while (find(positives.begin(), positives.end(), neg_label) != positives.end()
              && find_times < max_find_times);
     return neg_label;
 }
@@ -219,73 +263,210 @@ float Model::GetLog(float x) {
     return log_table_[i];
 }
 
+void Model::SetThreadId(int32_t thread_id) {
+    thread_id_ = thread_id;
+}
+
+void Model::AddLoss(double value, int64_t num) {
+    ThreadStat &stat = thread_stats_[thread_id_];
+    RelaxedAdd(&stat.loss_value, value);
+    RelaxedAdd(&stat.loss_num, num);
+}
+
+void Model::AddExample(int64_t word_num) {
+    ThreadStat &stat = thread_stats_[thread_id_];
+    RelaxedAdd(&stat.example_num, int64_t(1));
+    RelaxedAdd(&stat.word_num, word_num);
+}
+
 float Model::GetLoss() {
-    if (total_loss_num_ <= 1) {
+    double loss_value = 0;
+    int64_t loss_num = 0;
+    for (const ThreadStat &stat : thread_stats_) {
+        loss_value += stat.loss_value.load(std::memory_order_relaxed);
+        loss_num += stat.loss_num.load(std::memory_order_relaxed);
+    }
+    if (loss_num <= 1) {
         return -1;
     } else {
-        float res = total_loss_value_ / total_loss_num_;
+        float res = loss_value / loss_num;
         return res;
     }
 }
 
-void Model::SoftMax(const vector<float> &hidden_vec,
+void Model::GetSpeed(float *example_speed, float *word_speed) {
+    int64_t example_num = 0;
+    int64_t word_num = 0;
+    for (const ThreadStat &stat : thread_stats_) {
+        example_num += stat.example_num.load(std::memory_order_relaxed);
+        word_num += stat.word_num.load(std::memory_order_relaxed);
+    }
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - last_time_).count();
+    seconds = max(seconds, 1e-6);
+    *example_speed = (example_num - last_example_num_) / seconds;
+    *word_speed = (word_num - last_word_num_) / seconds;
+    last_example_num_ = example_num;
+    last_word_num_ = word_num;
+    last_time_ = now;
+}
+
+void Model::SoftMax(const float *hidden_vec,
                     uint32_t target,
-                    vector<float> &grad,
-                    vector<float> &mask_vec) {
+                    float *grad,
+                    const float *mask_vec) {
+    uint32_t dim = args_conf_->dim_;
+    uint32_t row = output_layer_->row_;
+    // models are shared by the train threads so the buffers are per thread:
+    // the scores, and the masked hidden vec with the grad of the rows
+    static thread_local vector<float> scores;
+    static thread_local vector<float> buffer;
+    scores.resize(row);
+    // the mask is applied once to the hidden vec and once to the grad,
+    // a keep rate of 1 gives an all ones mask
+    bool use_mask = args_conf_->dropoutkeeprate_ < 1;
+    const float *input = hidden_vec;
+    float *row_grad = grad;
+    if (use_mask) {
+        buffer.assign(2 * dim, 0);
+        for (uint32_t i = 0; i < dim; i++) {
+            buffer[i] = hidden_vec[i] * mask_vec[i];
+        }
+        input = buffer.data();
+        row_grad = buffer.data() + dim;
+    }
     // compute yi = exp(i) / sum(exp(j))
-    vector<float> mul_vec(output_layer_->row_, 0);
-    utils::MatrixMul(output_layer_->data_, hidden_vec, mask_vec, mul_vec,
-                     output_layer_->row_, output_layer_->col_);
-    float maxval = mul_vec[0];
-    for (auto item : mul_vec) {
-        maxval = max(maxval, item);
+    float maxval = -std::numeric_limits<float>::max();
+    for (uint32_t i = 0; i < row; i++) {
+        scores[i] = kernels_->dot(utils::RowPtr(output_layer_->data_, i, dim), input, dim);
+        maxval = max(maxval, scores[i]);
+    }
+    float z = kernels_->exp_sum(scores.data(), maxval, row);
+
+    // update output and get grad, one pass over every row
+    float lr = boost_ * args_conf_->curlearnrate_ / z;
+    for (uint32_t i = 0; i < row; i++) {
+        float label = (i == target) ? z : 0.0;
+        float alpha = lr * (label - scores[i]);
+        kernels_->axpy_grad(row_grad, utils::RowPtr(output_layer_->data_, i, dim),
+                            input, alpha, dim);
     }
-    float z = 0;
-    for (uint32_t i = 0; i < mul_vec.size(); i++) {
-        mul_vec[i] = exp(mul_vec[i] - maxval);
-        z += mul_vec[i];
+    if (use_mask) {
+        kernels_->axpy_mask(grad, row_grad, mask_vec, 1, dim);
+    }
+    AddLoss(-GetLog(scores[target] / z), 1);
+}
+
+void Model::HierarchicalSoftMax(const float *hidden_vec,
+                                uint32_t target,
+                                float *grad,
+                                const float *mask_vec) {
+    const vector<int32_t> &path = output_layer_->paths_[target];
+    const vector<bool> &code = output_layer_->codes_[target];
+    for (uint32_t i = 0; i < path.size(); i++) {
+        UpdateBatch(hidden_vec, path[i], code[i] ? 1 : 0, grad, mask_vec);
     }
-    for (uint32_t i = 0; i < mul_vec.size(); i++) {
-        mul_vec[i] /= z;
+    AddLoss(0, 1);
+}
+
+void Model::SearchTree(const float *hidden_vec,
+                       const float *output,
+                       int32_t node,
+                       float score,
+                       float threshold,
+                       vector<pair<int32_t, float>> &leaves) {
+    if (score < threshold) {
+        return;
+    }
+    int32_t row = int32_t(output_layer_->row_);
+    if (node < row) {
+        leaves.push_back(make_pair(node, score));
+        return;
     }
+    uint32_t dim = args_conf_->dim_;
+    float f = GetSigmoid(kernels_->dot(
+        utils::RowPtr(output, node - row, dim), hidden_vec, dim));
+    // same clip as GetLog
+    f = min(max(f, 1e-5f), 1.0f - 1e-5f);
+    const pair<int32_t, int32_t> &child = output_layer_->children_[node - row];
+    SearchTree(hidden_vec, output, child.first, score + std::log(1.0 - f), threshold, leaves);
+    SearchTree(hidden_vec, output, child.second, score + std::log(f), threshold, leaves);
+}
 
-    // update output and get grad
-    for (uint32_t i = 0; i < mul_vec.size(); i++) {
-        float label = (i == target) ? 1.0 : 0.0;
-        float alpha = boost_ * args_conf_->curlearnrate_ * (label - mul_vec[i]);
-        utils::MatrixGetVec(&grad, output_layer_->data_, i,
-                            args_conf_->dim_, alpha, mask_vec);
-        utils::MatrixAdd(output_layer_->data_, i, hidden_vec,
-                         args_conf_->dim_, alpha, mask_vec);
+int32_t Model::PredictTree(const float *hidden_vec, const float *output) {
+    int32_t row = int32_t(output_layer_->row_);
+    // follow the likelier branch to get a leaf, then search the subtrees
+    // which still can beat it
+    uint32_t dim = args_conf_->dim_;
+    int32_t node = row + int32_t(output_layer_->children_.size()) - 1;
+    float score = 0;
+    while (node >= row) {
+        float f = GetSigmoid(kernels_->dot(
+            utils::RowPtr(output, node - row, dim), hidden_vec, dim));
+        f = min(max(f, 1e-5f), 1.0f - 1e-5f);
+        const pair<int32_t, int32_t> &child = output_layer_->children_[node - row];
+        if (f >= 0.5) {
+            node = child.second;
+            score += std::log(f);
+        } else {
+            node = child.first;
+            score += std::log(1.0 - f);
+        }
+    }
+    int32_t label = node;
+    static thread_local vector<pair<int32_t, float>> leaves;
+    leaves.clear();
+    SearchTree(hidden_vec, output, row + int32_t(output_layer_->children_.size()) - 1,
+               0, score, leaves);
+    for (uint32_t i = 0; i < leaves.size(); i++) {
+        if (leaves[i].second > score) {
+            score = leaves[i].second;
+            label = leaves[i].first;
+        }
     }
-    total_loss_value_ += -GetLog(mul_vec[target]);
-    total_loss_num_ += 1;
+    return label;
 }
 
-void Model::UpdateBatch(const vector<float> &hidden_vec,
+void Model::PredictTreeScore(const float *hidden_vec,
+                             vector<pair<int32_t, float>> &predict) {
+    predict.clear();
+    SearchTree(hidden_vec, output_layer_->data_,
+               int32_t(output_layer_->row_ + output_layer_->children_.size()) - 1,
+               0, -std::numeric_limits<float>::infinity(), predict);
+    for (uint32_t i = 0; i < predict.size(); i++) {
+        predict[i].second = exp(predict[i].second);
+    }
+    stable_sort(predict.begin(), predict.end(),
+        [](const pair<int32_t, float> &p1, const pair<int32_t, float> &p2) {
+            return p1.second > p2.second;
+        }
+    );
+}
+
+void Model::UpdateBatch(const float *hidden_vec,
                         uint32_t output,
                         uint32_t label,
-                        vector<float> &grad,
-                        vector<float> &mask_vec) {
-    float dow_val = utils::MatrixDowRow(output_layer_->data_, output,
-                        hidden_vec, args_conf_->dim_, mask_vec);
+                        float *grad,
+                        const float *mask_vec) {
+    uint32_t dim = args_conf_->dim_;
+    float *row = utils::RowPtr(output_layer_->data_, output, dim);
+    float dow_val = kernels_->dot_mask(row, hidden_vec, mask_vec, dim);
     float score = GetSigmoid(dow_val);
     double loss = (label == 1) ? -GetLog(score) : -GetLog(1.0 - score);
-    total_loss_value_ += loss;
+    AddLoss(loss, 0);
 
     float alpha = boost_ * args_conf_->curlearnrate_ * (static_cast<float>(label) - score);
-    utils::MatrixGetVec(&grad, output_layer_->data_, output,
-                        args_conf_->dim_, alpha, mask_vec);
-    utils::MatrixAdd(output_layer_->data_, output, hidden_vec,
-                     args_conf_->dim_, alpha, mask_vec);
+    kernels_->axpy_mask(grad, row, mask_vec, alpha, dim);
+    kernels_->axpy_mask(row, hidden_vec, mask_vec, alpha, dim);
 }
 
 void Model::UpdateNeg(const vector<int32_t> &input_vec,
-                      const vector<float> &hidden_vec,
-                      vector<float> &grad,
-                      vector<float> &mask_vec,
+                      const float *hidden_vec,
+                      float *grad,
+                      const float *mask_vec,
                       uint32_t output,
-                      map<uint32_t, uint32_t> &pos_counter,
+                      const vector<uint32_t> &positives,
+                      utils::Rng *rng,
                       bool use_neg,
                       uint32_t label) {
     if (input_vec.size() == 0) {
@@ -294,38 +475,271 @@ void Model::UpdateNeg(const vector<int32_t> &input_vec,
     UpdateBatch(hidden_vec, output, label, grad, mask_vec);
     if (use_neg) {
         for (int32_t neg = 0; neg < neg_sample_; neg++) {
-            uint32_t negOutput = GetNegativeLabel(pos_counter);
+            uint32_t negOutput = GetNegativeLabel(positives, rng);
             UpdateBatch(hidden_vec, negOutput, 0, grad, mask_vec);
         }
     }
-    total_loss_num_ += 1;
+    AddLoss(0, 1);
+}
+
+void Model::UpdateSkip(const TextIds &text, utils::Rng *rng) {
+    AddExample(text.words.size());
+    (this->*update_skip_)(text, rng);
+}
+void Model::UpdateCls(const TextIds &text, uint32_t label, utils::Rng *rng) {
+    AddExample(text.words.size());
+    // a loaded hs tree may replace the softmax after Init
+    if (batch_size_ > 1 && loss_fun_ == LossFun::softmax) {
+        UpdateClsBatch(text, label, rng);
+        return;
+    }
+    (this->*update_cls_)(text, label, rng);
+}
+void Model::UpdatePair(const TextIds &text_1,
+                       const TextIds &text_2,
+                       uint32_t label,
+                       utils::Rng *rng) {
+    AddExample(text_1.words.size() + text_2.words.size());
+    if (batch_size_ > 1) {
+        UpdatePairBatch(text_1, text_2, label, rng);
+        return;
+    }
+    (this->*update_pair_)(text_1, text_2, label, rng);
+}
+
+void Model::UpdateClsBatch(const TextIds &text, uint32_t label, utils::Rng *rng) {
+    static thread_local vector<int32_t> word_idx_vec;
+    ThreadBatch &batch = thread_batches_[thread_id_];
+    input_layer_->GetIdxVec(text, word_idx_vec, rng);
+    if (word_idx_vec.size() < 1 || boost_ <= 0.000001) {
+        return;
+    }
+    assert(label < cls_number_);
+    if (batch.words_1.size() <= batch.size) {
+        batch.words_1.resize(batch.size + 1);
+    }
+    input_layer_->MergeIdxs(word_idx_vec, &batch.words_1[batch.size]);
+    uint32_t dim = args_conf_->dim_;
+    batch.labels.resize(batch.size + 1);
+    batch.labels[batch.size] = label;
+    batch.masks.resize(uint64_t(batch.size + 1) * dim);
+    RandomMask(&batch.masks[uint64_t(batch.size) * dim], rng);
+    batch.size++;
+    if (batch.size >= batch_size_) {
+        FlushClsBatch(&batch);
+    }
+}
+
+void Model::UpdatePairBatch(const TextIds &text_1,
+                            const TextIds &text_2,
+                            uint32_t label,
+                            utils::Rng *rng) {
+    static thread_local vector<int32_t> word_idx_vec_1;
+    static thread_local vector<int32_t> word_idx_vec_2;
+    ThreadBatch &batch = thread_batches_[thread_id_];
+    input_layer_->GetIdxVec(text_1, word_idx_vec_1, rng);
+    input_layer_->GetIdxVec(text_2, word_idx_vec_2, rng);
+    if (word_idx_vec_1.size() < 1 || word_idx_vec_2.size() < 1
+        || boost_ <= 0.000001) {
+        return;
+    }
+    assert(label < cls_number_);
+    if (batch.words_1.size() <= batch.size) {
+        batch.words_1.resize(batch.size + 1);
+        batch.words_2.resize(batch.size + 1);
+    }
+    input_layer_->MergeIdxs(word_idx_vec_1, &batch.words_1[batch.size]);
+    input_layer_->MergeIdxs(word_idx_vec_2, &batch.words_2[batch.size]);
+    batch.labels.resize(batch.size + 1);
+    batch.labels[batch.size] = label;
+    batch.size++;
+    if (batch.size >= batch_size_) {
+        FlushPairBatch(&batch);
+    }
+}
+
+void Model::FlushBatch() {
+    ThreadBatch &batch = thread_batches_[thread_id_];
+    if (name_ == ModelName::cls) {
+        FlushClsBatch(&batch);
+    } else if (name_ == ModelName::pair) {
+        FlushPairBatch(&batch);
+    }
+}
+
+void Model::FlushClsBatch(ThreadBatch *batch) {
+    uint32_t size = batch->size;
+    batch->size = 0;
+    if (size == 0) {
+        return;
+    }
+    uint32_t dim = args_conf_->dim_;
+    uint32_t row = output_layer_->row_;
+    // per thread blocks: the masked hidden vecs and grads (size x dim), the
+    // scores by example (size x row) and by output row (row x size)
+    static thread_local vector<float> hidden;
+    static thread_local vector<float> grads;
+    static thread_local vector<float> scores;
+    static thread_local vector<float> row_scores;
+    hidden.assign(uint64_t(size) * dim, 0);
+    grads.assign(uint64_t(size) * dim, 0);
+    scores.resize(uint64_t(size) * row);
+    row_scores.resize(uint64_t(size) * row);
+    bool use_mask = args_conf_->dropoutkeeprate_ < 1;
+    for (uint32_t b = 0; b < size; b++) {
+        float *hidden_vec = &hidden[uint64_t(b) * dim];
+        input_layer_->GetLayerByIdxs(batch->words_1[b], hidden_vec);
+        if (use_mask) {
+            const float *mask_vec = &batch->masks[uint64_t(b) * dim];
+            for (uint32_t i = 0; i < dim; i++) {
+                hidden_vec[i] *= mask_vec[i];
+            }
+        }
+    }
+    // logits: every output row is read once against the hidden block
+    float *output = output_layer_->data_;
+    for (uint32_t i = 0; i < row; i++) {
+        kernels_->dot_rows(&row_scores[uint64_t(i) * size], hidden.data(),
+                           utils::RowPtr(output, i, dim), size, dim);
+    }
+    // softmax, then the scores become the alpha of every example and row
+    float lr = boost_ * args_conf_->curlearnrate_;
+    for (uint32_t b = 0; b < size; b++) {
+        float *score = &scores[uint64_t(b) * row];
+        for (uint32_t i = 0; i < row; i++) {
+            score[i] = row_scores[uint64_t(i) * size + b];
+        }
+        float maxval = *std::max_element(score, score + row);
+        float z = kernels_->exp_sum(score, maxval, row);
+        uint32_t target = batch->labels[b];
+        AddLoss(-GetLog(score[target] / z), 1);
+        for (uint32_t i = 0; i < row; i++) {
+            float label = (i == target) ? z : 0.0;
+            score[i] = lr * (label - score[i]) / z;
+            row_scores[uint64_t(i) * size + b] = score[i];
+        }
+    }
+    // grads and row updates block by block, a block of rows is read for
+    // the grads before it moves, once for the whole batch
+    const uint32_t block = 16;
+    for (uint32_t begin = 0; begin < row; begin += block) {
+        uint32_t end = min(row, begin + block);
+        for (uint32_t b = 0; b < size; b++) {
+            kernels_->axpy_rows(&grads[uint64_t(b) * dim], utils::RowPtr(output, begin, dim),
+                                &scores[uint64_t(b) * row + begin], end - begin, dim);
+        }
+        for (uint32_t i = begin; i < end; i++) {
+            kernels_->axpy_rows(utils::RowPtr(output, i, dim), hidden.data(),
+                                &row_scores[uint64_t(i) * size], size, dim);
+        }
+    }
+    for (uint32_t b = 0; b < size; b++) {
+        float *grad = &grads[uint64_t(b) * dim];
+        if (use_mask) {
+            const float *mask_vec = &batch->masks[uint64_t(b) * dim];
+            for (uint32_t i = 0; i < dim; i++) {
+                grad[i] *= mask_vec[i];
+            }
+        }
+        input_layer_->UpdateData(batch->words_1[b], grad);
+    }
+}
+
+void Model::FlushPairBatch(ThreadBatch *batch) {
+    uint32_t size = batch->size;
+    batch->size = 0;
+    if (size == 0) {
+        return;
+    }
+    uint32_t dim = args_conf_->dim_;
+    // per thread blocks of the hidden vecs of text 1 and text 2
+    static thread_local vector<float> hidden_1;
+    static thread_local vector<float> hidden_2;
+    static thread_local vector<float> alphas;
+    hidden_1.assign(uint64_t(size) * dim, 0);
+    hidden_2.assign(uint64_t(size) * dim, 0);
+    alphas.resize(size);
+    for (uint32_t b = 0; b < size; b++) {
+        float *hidden_vec_1 = &hidden_1[uint64_t(b) * dim];
+        float *hidden_vec_2 = &hidden_2[uint64_t(b) * dim];
+        input_layer_->GetLayerByIdxs(batch->words_1[b], hidden_vec_1);
+        input_layer_->GetLayerByIdxs(batch->words_2[b], hidden_vec_2);
+        float score = GetSigmoid(kernels_->dot(hidden_vec_1, hidden_vec_2, dim));
+        uint32_t label = batch->labels[b];
+        double loss = (label == 1) ? -GetLog(score) : -GetLog(1.0 - score);
+        AddLoss(loss, 1);
+        alphas[b] = boost_ * args_conf_->curlearnrate_ * (static_cast<float>(label) - score);
+    }
+    for (uint32_t b = 0; b < size; b++) {
+        input_layer_->UpdateData(batch->words_1[b], &hidden_2[uint64_t(b) * dim], alphas[b]);
+        input_layer_->UpdateData(batch->words_2[b], &hidden_1[uint64_t(b) * dim], alphas[b]);
+    }
+}
+float Model::PredictPair(const vector<int32_t> &input_idx_vec_1,
+                         const vector<int32_t> &input_idx_vec_2) {
+    return (this->*predict_pair_)(input_idx_vec_1, input_idx_vec_2);
+}
+int32_t Model::PredictCls(const vector<int32_t> &input_idx_vec) {
+    return (this->*predict_cls_)(input_idx_vec);
+}
+void Model::PredictClsScore(const vector<int32_t> &input_idx_vec,
+                            vector<pair<int32_t, float>> &predict) {
+    (this->*predict_cls_score_)(input_idx_vec, predict);
+}
+int32_t Model::PredictCls(const float *hidden_vec, const vector<float> &output) {
+    if (loss_fun_ == LossFun::hs) {
+        return PredictTree(hidden_vec, output.data());
+    }
+    uint32_t dim = args_conf_->dim_;
+    float max_score = -1000000;
+    int32_t label = -1;
+    for (uint32_t i = 0; i < output_layer_->row_; i++) {
+        float score = kernels_->dot(utils::RowPtr(output.data(), i, dim), hidden_vec, dim);
+        if (score > max_score) {
+            max_score = score;
+            label = int32_t(i);
+        }
+    }
+    return label;
+}
+float Model::PredictPair(const float *hidden_vec_1, const float *hidden_vec_2) {
+    return GetSigmoid(kernels_->dot(hidden_vec_1, hidden_vec_2, args_conf_->dim_));
 }
 
-void Model::UpdateSkip(const string &text) {
+template<uint32_t DIM>
+void Model::UpdateSkipDim(const TextIds &text, utils::Rng *rng) {
     assert(args_conf_->ngram_ >= 1);
-    vector<string> word_list;
-    utils::GetSegedWordList(text, word_list);
-    if (static_cast<int>(word_list.size()) < args_conf_->minlen_
-        || static_cast<int>(word_list.size()) > args_conf_->maxlen_) {
+    // per thread buffers, they keep their capacity between examples
+    static thread_local vector<uint32_t> positives;
+    static thread_local vector<int32_t> input_vec;
+    static thread_local MergedIdxs input_rows;
+    static thread_local vector<int32_t> word_idx_vec;
+    const vector<int32_t> &word_list = text.words;
+    if (word_list.empty()) {
         return;
     }
-    map<uint32_t, uint32_t> pos_counter;
-    vector<int32_t> input_vec;
-    vector<int32_t> word_idx_vec;
-    hash_table_->RandomDiscard(&word_list, word_idx_vec, boost_freq_sample_);
-    string ngram_str;
-    
+    word_idx_vec.assign(word_list.begin(), word_list.end());
+    hash_table_->DiscardWordIdx(word_idx_vec, rng, boost_freq_sample_);
+    uint32_t ngram = args_conf_->ngram_;
+    utils::DimBuffer<DIM> hidden_vec(args_conf_->dim_);
+    utils::DimBuffer<DIM> grad(args_conf_->dim_);
+    utils::DimBuffer<DIM> mask_vec(args_conf_->dim_);
+
     for (uint32_t i = 0; i < word_list.size(); i++) {
-        for (uint32_t n = 1; n <= args_conf_->ngram_; n++) {
+        for (uint32_t n = 1; n <= ngram; n++) {
             uint32_t end = i + n - 1;
             if (end >= word_list.size()) {
                 break;
             }
-            ngram_str = utils::GetNgramWord(word_list, word_idx_vec, i, end);
-            if (ngram_str == "") {
-                break;
+            // the start word is kept even if it is discarded,
+            // an ngram stops at the first discarded word after it
+            int32_t ngram_pos = word_list[i];
+            if (n > 1) {
+                if (word_idx_vec[end] < 0) {
+                    break;
+                }
+                ngram_pos = text.phrases[i * (ngram - 1) + n - 2];
             }
-            int32_t ngram_pos = hash_table_->GetWordPos(ngram_str);
             if (ngram_pos < 0) {
                 break;
             }
@@ -334,32 +748,31 @@ void Model::UpdateSkip(const string &text) {
             input_vec.clear();
             input_vec.push_back(ngram_pos);
             if (n == 1) {
-                input_vec.insert(input_vec.end(),
-                    hash_table_->wordvec_[ngram_pos].subwords.begin(),
-                    hash_table_->wordvec_[ngram_pos].subwords.end());
+                SubwordSpan subwords = hash_table_->Subwords(ngram_pos);
+                input_vec.insert(input_vec.end(), subwords.begin(), subwords.end());
             }
             // use hidden vector
-            vector<float> hidden_vec(args_conf_->dim_, 0);
-            input_layer_->GetLayerByIdxs(input_vec, hidden_vec, 1);
-            vector<float> grad(args_conf_->dim_, 0);
-            
+            input_layer_->MergeIdxs(input_vec, &input_rows);
+            hidden_vec.Clear();
+            input_layer_->GetLayerByIdxs(input_rows, hidden_vec.Data());
+            grad.Clear();
+
             // random drop out
-            vector<float> mask_vec(args_conf_->dim_, 0);
-            RandomMask(mask_vec);
+            RandomMask(mask_vec.Data(), rng);
 
-            pos_counter.clear();
-            pos_counter[ngram_pos] = 1;
-            int32_t boundary = GetRandInt(1, args_conf_->windowsize_);
+            positives.assign(1, uint32_t(ngram_pos));
+            int32_t boundary = GetRandInt(1, args_conf_->windowsize_, rng);
 
-            // update left
+            // update left, signed so that the window stops at word 0
+            int32_t start = int32_t(i);
             int32_t lbound = boundary;
-            for (int32_t j = i-1; j >= 0 && j >= i-lbound; j--) {
+            for (int32_t j = start-1; j >= 0 && j >= start-lbound; j--) {
                 if (word_idx_vec[j] < 0) {
                     lbound++;
                     continue;
                 }
-                UpdateNeg(input_vec, hidden_vec, grad, mask_vec,
-                          word_idx_vec[j], pos_counter);
+                UpdateNeg(input_vec, hidden_vec.Data(), grad.Data(),
+                          mask_vec.Data(), word_idx_vec[j], positives, rng);
             }
 
             // update right
@@ -370,91 +783,112 @@ void Model::UpdateSkip(const string &text) {
                     rbound++;
                     continue;
                 }
-                UpdateNeg(input_vec, hidden_vec, grad, mask_vec,
-                        word_idx_vec[j], pos_counter);
+                UpdateNeg(input_vec, hidden_vec.Data(), grad.Data(),
+                          mask_vec.Data(), word_idx_vec[j], positives, rng);
             }
 
             // update grad to input layer
-            input_layer_->UpdateData(input_vec, grad);
+            input_layer_->UpdateData(input_rows, grad.Data());
         }
     }
 }
 
-void Model::UpdateCls(const string &text, uint32_t label) {
-    vector<int32_t> word_idx_vec;
-    input_layer_->GetIdxVec(text, word_idx_vec);
+template<uint32_t DIM>
+void Model::UpdateClsDim(const TextIds &text, uint32_t label, utils::Rng *rng) {
+    static thread_local vector<int32_t> word_idx_vec;
+    static thread_local MergedIdxs word_rows;
+    static thread_local vector<uint32_t> positives;
+    input_layer_->GetIdxVec(text, word_idx_vec, rng);
 
     if (word_idx_vec.size() < 1 || boost_ <= 0.000001) {
         return;
     }
     assert(label < cls_number_);
-    vector<float> hidden_vec(args_conf_->dim_, 0);
-    input_layer_->GetLayerByIdxs(word_idx_vec, hidden_vec, 1);
-    vector<float> grad(args_conf_->dim_, 0);
-    map<uint32_t, uint32_t> pos_counter;
-    pos_counter[label] = 1;
+    // a long text repeats words, subwords and phrases, every row is
+    // read and updated once
+    input_layer_->MergeIdxs(word_idx_vec, &word_rows);
+    utils::DimBuffer<DIM> hidden_vec(args_conf_->dim_);
+    input_layer_->GetLayerByIdxs(word_rows, hidden_vec.Data());
+    utils::DimBuffer<DIM> grad(args_conf_->dim_);
+    positives.assign(1, label);
 
     // random drop out
-    vector<float> mask_vec(args_conf_->dim_, 0);
-    RandomMask(mask_vec);
+    utils::DimBuffer<DIM> mask_vec(args_conf_->dim_);
+    RandomMask(mask_vec.Data(), rng);
 
     if (loss_fun_ == LossFun::softmax) {
-        SoftMax(hidden_vec, label, grad, mask_vec);
+        SoftMax(hidden_vec.Data(), label, grad.Data(), mask_vec.Data());
+    } else if (loss_fun_ == LossFun::hs) {
+        HierarchicalSoftMax(hidden_vec.Data(), label, grad.Data(), mask_vec.Data());
     } else {
-        UpdateNeg(word_idx_vec, hidden_vec, grad, mask_vec, label, pos_counter);
+        UpdateNeg(word_idx_vec, hidden_vec.Data(), grad.Data(), mask_vec.Data(),
+                  label, positives, rng);
     }
-    input_layer_->UpdateData(word_idx_vec, grad);
+    input_layer_->UpdateData(word_rows, grad.Data());
 }
 
-void Model::UpdatePair(const string &text_1,
-                        const string &text_2,
-                        uint32_t label) {
-    vector<int32_t> word_idx_vec_1;
-    input_layer_->GetIdxVec(text_1, word_idx_vec_1);
-    vector<int32_t> word_idx_vec_2;
-    input_layer_->GetIdxVec(text_2, word_idx_vec_2);
+template<uint32_t DIM>
+void Model::UpdatePairDim(const TextIds &text_1,
+                          const TextIds &text_2,
+                          uint32_t label,
+                          utils::Rng *rng) {
+    static thread_local vector<int32_t> word_idx_vec_1;
+    static thread_local vector<int32_t> word_idx_vec_2;
+    static thread_local MergedIdxs word_rows_1;
+    static thread_local MergedIdxs word_rows_2;
+    input_layer_->GetIdxVec(text_1, word_idx_vec_1, rng);
+    input_layer_->GetIdxVec(text_2, word_idx_vec_2, rng);
 
     if (word_idx_vec_1.size() < 1 || word_idx_vec_2.size() < 1
         || boost_ <= 0.000001) {
         return;
     }
     assert(label < cls_number_);
-    vector<float> hidden_vec_1(args_conf_->dim_, 0);
-    vector<float> hidden_vec_2(args_conf_->dim_, 0);
-    input_layer_->GetLayerByIdxs(word_idx_vec_1, hidden_vec_1, 1);
-    input_layer_->GetLayerByIdxs(word_idx_vec_2, hidden_vec_2, 1);
-
-    float dow_val = utils::DowRow(hidden_vec_1, hidden_vec_2);
+    utils::DimBuffer<DIM> hidden_vec_1(args_conf_->dim_);
+    utils::DimBuffer<DIM> hidden_vec_2(args_conf_->dim_);
+    input_layer_->MergeIdxs(word_idx_vec_1, &word_rows_1);
+    input_layer_->MergeIdxs(word_idx_vec_2, &word_rows_2);
+    input_layer_->GetLayerByIdxs(word_rows_1, hidden_vec_1.Data());
+    input_layer_->GetLayerByIdxs(word_rows_2, hidden_vec_2.Data());
+
+    float dow_val = kernels_->dot(hidden_vec_1.Data(), hidden_vec_2.Data(),
+                                  args_conf_->dim_);
     float score = GetSigmoid(dow_val);
     double loss = (label == 1) ? -GetLog(score) : -GetLog(1.0 - score);
-    total_loss_value_ += loss;
-    total_loss_num_ += 1;
+    AddLoss(loss, 1);
 
     float alpha = boost_ * args_conf_->curlearnrate_ * (static_cast<float>(label) - score);
-    input_layer_->UpdateData(word_idx_vec_1, hidden_vec_2, alpha);
-    input_layer_->UpdateData(word_idx_vec_2, hidden_vec_1, alpha);
+    input_layer_->UpdateData(word_rows_1, hidden_vec_2.Data(), alpha);
+    input_layer_->UpdateData(word_rows_2, hidden_vec_1.Data(), alpha);
 }
 
-float Model::PredictPair(const vector<int32_t> &input_idx_vec_1,
-                         const vector<int32_t> &input_idx_vec_2) {
-    vector<float> hidden_vec_1(args_conf_->dim_, 0);
-    vector<float> hidden_vec_2(args_conf_->dim_, 0);
-    input_layer_->GetLayerByIdxs(input_idx_vec_1, hidden_vec_1, 1);
-    input_layer_->GetLayerByIdxs(input_idx_vec_2, hidden_vec_2, 1);
-    float dow_val = utils::DowRow(hidden_vec_1, hidden_vec_2);
+template<uint32_t DIM>
+float Model::PredictPairDim(const vector<int32_t> &input_idx_vec_1,
+                            const vector<int32_t> &input_idx_vec_2) {
+    utils::DimBuffer<DIM> hidden_vec_1(args_conf_->dim_);
+    utils::DimBuffer<DIM> hidden_vec_2(args_conf_->dim_);
+    input_layer_->GetLayerByIdxs(input_idx_vec_1, hidden_vec_1.Data(), 1);
+    input_layer_->GetLayerByIdxs(input_idx_vec_2, hidden_vec_2.Data(), 1);
+    float dow_val = kernels_->dot(hidden_vec_1.Data(), hidden_vec_2.Data(),
+                                  args_conf_->dim_);
     float score = GetSigmoid(dow_val);
     return score;
 }
 
-int32_t Model::PredictCls(const vector<int32_t> &input_idx_vec) {
-    vector<float> hidden_layer(args_conf_->dim_, 0);
+template<uint32_t DIM>
+int32_t Model::PredictClsDim(const vector<int32_t> &input_idx_vec) {
+    uint32_t dim = args_conf_->dim_;
+    utils::DimBuffer<DIM> hidden_layer(dim);
     // input_layer_->GetLayerByIdxs(input_idx_vec, hidden_layer, boost_freq_sample_, true);
-    input_layer_->GetLayerByIdxs(input_idx_vec, hidden_layer, 1);
+    input_layer_->GetLayerByIdxs(input_idx_vec, hidden_layer.Data(), 1);
+    if (loss_fun_ == LossFun::hs) {
+        return PredictTree(hidden_layer.Data(), output_layer_->data_);
+    }
     float max_score = -1000000;
     int32_t label = -1;
     for (uint32_t i = 0; i < output_layer_->row_; i++) {
-        float score = utils::MatrixDowRow(output_layer_->data_, i,
-                                          hidden_layer, args_conf_->dim_);
+        float score = kernels_->dot(utils::RowPtr(output_layer_->data_, i, dim),
+                                    hidden_layer.Data(), dim);
         if (score > max_score) {
             max_score = score;
             label = int32_t(i);
@@ -463,16 +897,22 @@ int32_t Model::PredictCls(const vector<int32_t> &input_idx_vec) {
     return label;
 }
 
-void Model::PredictClsScore(const vector<int32_t> &input_idx_vec,
-                              vector<pair<int32_t, float>> &predict) {
+template<uint32_t DIM>
+void Model::PredictClsScoreDim(const vector<int32_t> &input_idx_vec,
+                               vector<pair<int32_t, float>> &predict) {
     predict.clear();
+    uint32_t dim = args_conf_->dim_;
     float max_score = -1000000;
-    vector<float> hidden_layer(args_conf_->dim_, 0);
+    utils::DimBuffer<DIM> hidden_layer(dim);
     // input_layer_->GetLayerByIdxs(input_idx_vec, hidden_layer, boost_freq_sample_, true);
-    input_layer_->GetLayerByIdxs(input_idx_vec, hidden_layer, 1);
+    input_layer_->GetLayerByIdxs(input_idx_vec, hidden_layer.Data(), 1);
+    if (loss_fun_ == LossFun::hs) {
+        PredictTreeScore(hidden_layer.Data(), predict);
+        return;
+    }
     for (uint32_t i = 0; i < output_layer_->row_; i++) {
-        float score = utils::MatrixDowRow(output_layer_->data_, i,
-                                          hidden_layer, args_conf_->dim_);
+        float score = kernels_->dot(utils::RowPtr(output_layer_->data_, i, dim),
+                                    hidden_layer.Data(), dim);
         pair<int32_t, float> p(int32_t(i), score);
         predict.push_back(p);
         max_score = (i == 0) ? score : max(max_score, score);
@@ -499,16 +939,42 @@ void Model::Save(bool save_common_data) {
         hash_table_->Save(args_conf_);
         input_layer_->Save();
     }
-    if (name_ == ModelName::pair
-       || name_ == ModelName::cls
-       || (name_ == ModelName::skip && args_conf_->useskipgram_)) {
+    if (HasOutput()) {
         output_layer_->Save();
     }
 }
+
+bool Model::HasOutput() {
+    return name_ == ModelName::pair
+       || name_ == ModelName::cls
+       || (name_ == ModelName::skip && args_conf_->useskipgram_);
+}
+
+void Model::Snapshot(vector<float> *data) {
+    output_layer_->Snapshot(data);
+}
+
+void Model::SaveSnapshot(const string &dir, const vector<float> &data) {
+    output_layer_->SaveSnapshot(dir, data);
+}
+
 void Model::Load(const map<string, int32_t> &tag_count_map) {
     if (name_ == ModelName::cls
        || (name_ == ModelName::skip && args_conf_->useskipgram_)) {
         output_layer_->Load();
+    } else if (output_layer_->data_ == NULL) {
+        output_layer_->Init();
+    }
+    if (name_ == ModelName::cls) {
+        // the tree saved with the output layer decides the loss
+        if (output_layer_->HasTree()) {
+            if (loss_fun_ != LossFun::hs) {
+                cerr << "cls " << class_tag_ << " use hs loss of the saved tree" << endl;
+            }
+            loss_fun_ = LossFun::hs;
+        } else if (loss_fun_ == LossFun::hs) {
+            InitTree(tag_count_map);
+        }
     }
     if (name_ == ModelName::skip) {
         InitNegTable();
@@ -518,4 +984,25 @@ void Model::Load(const map<string, int32_t> &tag_count_map) {
         cerr << "pair do not need initNegTable" << endl;
     }
 }
+
+void Model::Grow(int32_t cls_number, const map<string, int32_t> &tag_count_map) {
+    bool grown = uint32_t(cls_number) > cls_number_;
+    if (grown) {
+        output_layer_->Grow(uint32_t(cls_number));
+        cls_number_ = uint32_t(cls_number);
+    }
+    if (name_ == ModelName::skip) {
+        InitNegTable();
+    } else if (name_ == ModelName::cls) {
+        InitNegTable(tag_count_map);
+        // new labels need leaves, the new tree splits the labels another
+        // way, so its inner rows start from zero as in a new model
+        if (grown && loss_fun_ == LossFun::hs) {
+            InitTree(tag_count_map);
+            uint32_t dim = args_conf_->dim_;
+            memset(output_layer_->data_, 0,
+                   uint64_t(cls_number_ - 1) * dim * sizeof(float));
+        }
+    }
+}
 } // namespace knowledgeembedding
@@ -5,6 +5,9 @@
 #ifndef KNOWLEDGE_EMBEDDING_MODEL_H
 #define KNOWLEDGE_EMBEDDING_MODEL_H
 
+#include <atomic>
+#include <chrono>
+#include <limits>
 #include <map>
 #include <string>
 #include <utility>
@@ -12,18 +15,41 @@
 
 #include "layers/inputlayer.h"
 #include "layers/outputlayer.h"
+#include "utils/aliastable.h"
 #include "utils/argsconf.h"
 #include "utils/basicutil.h"
 #include "utils/matrixutil.h"
+#include "utils/simdutil.h"
 #include "utils/textutil.h"
 #include "utils/vectorutil.h"
 
 #define SIGMOID_TABLE_SIZE 512
 #define MAX_SIGMOID 8
 #define LOG_TABLE_SIZE 512
-#define NEG_TABLE_SIZE 10000000
 
 namespace knowledgeembedding {
+// loss and throughput counters of one train thread. only the owner thread
+// writes them, relaxed atomics let the reporting thread read them without
+// a data race and the padding keeps every thread on its own cache line
+struct alignas(64) ThreadStat {
+    atomic<double> loss_value{0};
+    atomic<int64_t> loss_num{0};
+    atomic<int64_t> example_num{0};
+    atomic<int64_t> word_num{0};
+};
+
+// cls / pair examples of one train thread waiting for their batch update,
+// the vectors keep their capacity between batches
+struct alignas(64) ThreadBatch {
+    uint32_t size = 0;
+    // the merged input rows of text 1 and text 2
+    vector<MergedIdxs> words_1;
+    vector<MergedIdxs> words_2;
+    vector<uint32_t> labels;
+    // the dropout mask of every cls example
+    vector<float> masks;
+};
+
 class Model {
     public:
         Model(shared_ptr<ArgsConf> args_conf,
@@ -31,20 +57,25 @@ class Model {
               int32_t cls_number,
               shared_ptr<InputLayer> input_layer,
               const string &tag,
-              shared_ptr<HashTable> hash_table);
+              shared_ptr<HashTable> hash_table,
+              bool need_init = true);
         ~Model();
         // init model
         void Init();
         // init mask vector
-        void RandomMask(vector<float> &mask_vec);
+        void RandomMask(float *mask_vec, utils::Rng *rng);
         // get random number
-        float GetRandFloat(float min, float max);
-        int32_t GetRandInt(int32_t min, int32_t max);
+        float GetRandFloat(float min, float max, utils::Rng *rng);
+        int32_t GetRandInt(int32_t min, int32_t max, utils::Rng *rng);
         // init negative sampling table
         void InitNegTable();
         void InitNegTable(const map<string, int32_t> &tag_count_map);
-        uint32_t GetNegativeLabel(uint32_t positive_label);
-        uint32_t GetNegativeLabel(const map<uint32_t, uint32_t> &pos_counter,
+        // build the huffman tree of the hs loss from the label counts
+        void InitTree(const map<string, int32_t> &tag_count_map);
+        // draw from the negative alias table with the thread rng
+        uint32_t GetNegativeLabel(uint32_t positive_label, utils::Rng *rng);
+        uint32_t GetNegativeLabel(const vector<uint32_t> &positives,
+                                  utils::Rng *rng,
                                   uint32_t max_find_times = 50);
         // init sigmoid table
         void InitSigmoid();
@@ -52,36 +83,51 @@ class Model {
         // init log table
         void InitLog();
         float GetLog(float x);
-        // get model mean loss
+        // the train thread index of the calling thread, 0 by default
+        static void SetThreadId(int32_t thread_id);
+        // get model mean loss, summed over the train threads
         float GetLoss();
-        // soft max function
-        void SoftMax(const vector<float> &hidden_vec,
+        // examples and words per second since the last call,
+        // only the reporting thread calls it
+        void GetSpeed(float *example_speed, float *word_speed);
+        // soft max function, hidden_vec, grad and mask_vec point to dim_ floats
+        void SoftMax(const float *hidden_vec,
                      uint32_t target,
-                     vector<float> &grad,
-                     vector<float> &mask_vec);
+                     float *grad,
+                     const float *mask_vec);
+        // hierarchical soft max, only the inner nodes on the path of target
+        void HierarchicalSoftMax(const float *hidden_vec,
+                                 uint32_t target,
+                                 float *grad,
+                                 const float *mask_vec);
         // update base function
-        void UpdateBatch(const vector<float> &hidden_vec,
+        void UpdateBatch(const float *hidden_vec,
                          uint32_t output,
                          uint32_t label,
-                         vector<float> &grad,
-                         vector<float> &mask_vec);
+                         float *grad,
+                         const float *mask_vec);
         // negtive sampling update
         void UpdateNeg(const vector<int32_t> &input_vec,
-                       const vector<float> &hidden_vec,
-                       vector<float> &grad,
-                       vector<float> &mask_vec,
+                       const float *hidden_vec,
+                       float *grad,
+                       const float *mask_vec,
                        uint32_t output,
-                       map<uint32_t, uint32_t> &pos_counter,
+                       const vector<uint32_t> &positives,
+                       utils::Rng *rng,
                        bool use_neg = true,
                        uint32_t label = 1);
-        // train skip model
-        void UpdateSkip(const string &text);
+        // train skip model, rng is the random stream of the train thread
+        void UpdateSkip(const TextIds &text, utils::Rng *rng);
         // train classify model
-        void UpdateCls(const string &text, uint32_t label);
+        void UpdateCls(const TextIds &text, uint32_t label, utils::Rng *rng);
         // train pair model
-        void UpdatePair(const string &text_1,
-                        const string &text_2,
-                        uint32_t label);
+        void UpdatePair(const TextIds &text_1,
+                        const TextIds &text_2,
+                        uint32_t label,
+                        utils::Rng *rng);
+        // update with the examples the calling thread has not trained yet
+        // in batch mode (cls_<tag>_batch / pair_<tag>_batch > 1)
+        void FlushBatch();
         float PredictPair(const vector<int32_t> &input_idx_vec_1,
                           const vector<int32_t> &input_idx_vec_2);
         // predict the label of example
@@ -89,15 +135,70 @@ class Model {
         // predict score
         void PredictClsScore(const vector<int32_t> &input_idx_vec,
                              vector<pair<int32_t, float>> &predict);
+        // predict from hidden vecs and an output layer copied by Snapshot,
+        // the async eval scores the copy while the train threads go on
+        int32_t PredictCls(const float *hidden_vec, const vector<float> &output);
+        float PredictPair(const float *hidden_vec_1, const float *hidden_vec_2);
 
         // save and load
         void Save(bool save_common_data);
         void Load(const map<string, int32_t> &tag_count_map);
+        // checkpoints: copy and write the output layer that Save writes,
+        // the input layer and vocab are shared and written once
+        bool HasOutput();
+        void Snapshot(vector<float> *data);
+        void SaveSnapshot(const string &dir, const vector<float> &data);
+        // continued training of a loaded model: the output grows to
+        // cls_number rows and the sampling tables follow the new counts
+        void Grow(int32_t cls_number, const map<string, int32_t> &tag_count_map);
 
     public:
         bool use_as_skip_example_ = false;
         float boost_freq_sample_ = 1.0;
 
+    private:
+        // add to the counters of the calling thread
+        void AddLoss(double value, int64_t num);
+        void AddExample(int64_t word_num);
+        // walk the huffman tree, prune the subtrees whose log probability
+        // is below threshold, collect the leaf probabilities
+        void SearchTree(const float *hidden_vec,
+                        const float *output,
+                        int32_t node,
+                        float score,
+                        float threshold,
+                        vector<pair<int32_t, float>> &leaves);
+        int32_t PredictTree(const float *hidden_vec, const float *output);
+        void PredictTreeScore(const float *hidden_vec,
+                              vector<pair<int32_t, float>> &predict);
+        // batch mode: collect the example of the calling thread, and update
+        // when batch_size_ are collected. cls batches need the softmax loss
+        void UpdateClsBatch(const TextIds &text, uint32_t label, utils::Rng *rng);
+        void UpdatePairBatch(const TextIds &text_1,
+                             const TextIds &text_2,
+                             uint32_t label,
+                             utils::Rng *rng);
+        // the scores of the batch against every output row are computed with
+        // the rows of the last batch, then each row moves once
+        void FlushClsBatch(ThreadBatch *batch);
+        // the scores are computed with the input rows of the last batch
+        void FlushPairBatch(ThreadBatch *batch);
+        // bind the hot paths specialized for DIM, 0 is the generic version
+        template<uint32_t DIM> void BindDim();
+        template<uint32_t DIM> void UpdateSkipDim(const TextIds &text, utils::Rng *rng);
+        template<uint32_t DIM> void UpdateClsDim(const TextIds &text,
+                                                 uint32_t label,
+                                                 utils::Rng *rng);
+        template<uint32_t DIM> void UpdatePairDim(const TextIds &text_1,
+                                                  const TextIds &text_2,
+                                                  uint32_t label,
+                                                  utils::Rng *rng);
+        template<uint32_t DIM> float PredictPairDim(const vector<int32_t> &input_idx_vec_1,
+                                                    const vector<int32_t> &input_idx_vec_2);
+        template<uint32_t DIM> int32_t PredictClsDim(const vector<int32_t> &input_idx_vec);
+        template<uint32_t DIM> void PredictClsScoreDim(const vector<int32_t> &input_idx_vec,
+                                                       vector<pair<int32_t, float>> &predict);
+
     private:
         shared_ptr<ArgsConf> args_conf_;
         ModelName name_;
@@ -107,16 +208,18 @@ class Model {
 
         float boost_ = 1.0;
         int32_t neg_sample_ = 5;
+        // examples of one update of cls / pair, 1 is one by one
+        uint32_t batch_size_ = 1;
 
-        int64_t total_loss_num_ = 0;
-        double total_loss_value_ = 0.0;
-
-        uint64_t rand_long_ = 1;
-        minstd_rand rng_;
-        uniform_real_distribution<> uniform_;
+        static thread_local int32_t thread_id_;
+        vector<ThreadStat> thread_stats_;
+        vector<ThreadBatch> thread_batches_;
+        int64_t last_example_num_ = 0;
+        int64_t last_word_num_ = 0;
+        std::chrono::steady_clock::time_point last_time_;
 
-        uint64_t neg_table_index_ = 0;
-        vector<int32_t> neg_table_;
+        // negative labels (cls) or words (skip) by count^0.5
+        utils::AliasTable neg_table_;
 
         float *sigmoid_table_;
         float *log_table_;
@@ -124,6 +227,20 @@ class Model {
         shared_ptr<HashTable> hash_table_;
         shared_ptr<InputLayer> input_layer_;
         shared_ptr<OutputLayer> output_layer_;
+
+        // kernels unrolled for dim_ and the bound hot paths
+        const utils::Kernels *kernels_;
+        void (Model::*update_skip_)(const TextIds &text, utils::Rng *rng);
+        void (Model::*update_cls_)(const TextIds &text, uint32_t label, utils::Rng *rng);
+        void (Model::*update_pair_)(const TextIds &text_1,
+                                    const TextIds &text_2,
+                                    uint32_t label,
+                                    utils::Rng *rng);
+        float (Model::*predict_pair_)(const vector<int32_t> &input_idx_vec_1,
+                                      const vector<int32_t> &input_idx_vec_2);
+        int32_t (Model::*predict_cls_)(const vector<int32_t> &input_idx_vec);
+        void (Model::*predict_cls_score_)(const vector<int32_t> &input_idx_vec,
+                                          vector<pair<int32_t, float>> &predict);
 }; // Model
 } // namespace knowledgeembedding
 #endif // KNOWLEDGE_EMBEDDING_MODEL_H
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#include "aliastable.h"
+
+namespace knowledgeembedding {
+namespace utils {
+AliasTable::AliasTable() {
+}
+
+AliasTable::~AliasTable() {
+}
+
+void AliasTable::Clear() {
+    entries_.clear();
+    entries_.shrink_to_fit();
+}
+
+void AliasTable::Build(const vector<uint32_t> &values, const vector<double> &weights) {
+    assert(values.size() == weights.size());
+    entries_.clear();
+    vector<double> scaled;
+    double sum = 0;
+    for (uint32_t i = 0; i < values.size(); i++) {
+        if (weights[i] > 0) {
+            entries_.push_back({1.0f, values[i], values[i]});
+            scaled.push_back(weights[i]);
+            sum += weights[i];
+        }
+    }
+    uint32_t size = uint32_t(entries_.size());
+    // vose: scale the weights to mean 1, every small entry is topped up
+    // to 1 by one large entry, which then goes on as small or large
+    vector<uint32_t> small;
+    vector<uint32_t> large;
+    for (uint32_t i = 0; i < size; i++) {
+        scaled[i] = scaled[i] * size / sum;
+        if (scaled[i] < 1) {
+            small.push_back(i);
+        } else {
+            large.push_back(i);
+        }
+    }
+    while (!small.empty() && !large.empty()) {
+        uint32_t s = small.back();
+        small.pop_back();
+        uint32_t l = large.back();
+        entries_[s].prob = float(scaled[s]);
+        entries_[s].alias = entries_[l].value;
+        scaled[l] -= 1 - scaled[s];
+        if (scaled[l] < 1) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // the rest is 1 up to rounding
+    for (auto i : small) {
+        entries_[i].prob = 1;
+    }
+    for (auto i : large) {
+        entries_[i].prob = 1;
+    }
+}
+} // namespace utils
+} // namespace knowledgeembedding
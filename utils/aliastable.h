@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#ifndef KNOWLEDGE_EMBEDDING_UTILS_ALIASTABLE_H
+#define KNOWLEDGE_EMBEDDING_UTILS_ALIASTABLE_H
+
+#include <vector>
+
+#include "basicutil.h"
+
+namespace knowledgeembedding {
+namespace utils {
+    // walker alias table: draws values[i] with probability weights[i] / sum
+    // in O(1), one entry per value. entry i keeps its own value with
+    // probability prob and the value of its alias otherwise
+    class AliasTable {
+        public:
+            AliasTable();
+            ~AliasTable();
+            // values with weight <= 0 are never drawn
+            void Build(const vector<uint32_t> &values, const vector<double> &weights);
+            void Clear();
+            bool Empty() const { return entries_.empty(); }
+            uint32_t Size() const { return uint32_t(entries_.size()); }
+            uint64_t MemorySize() const { return entries_.size() * sizeof(Entry); }
+            // rng is the random stream of the calling thread
+            uint32_t Sample(Rng *rng) const {
+                const Entry &entry = entries_[rng->Int(0, int32_t(entries_.size()) - 1)];
+                return rng->Uniform() < entry.prob ? entry.value : entry.alias;
+            }
+
+        private:
+            struct Entry {
+                float prob;
+                uint32_t value;
+                uint32_t alias;
+            };
+            vector<Entry> entries_;
+    };
+} // namespace utils
+} // namespace knowledgeembedding
+#endif // KNOWLEDGE_EMBEDDING_UTILS_ALIASTABLE_H
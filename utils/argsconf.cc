@@ -17,6 +17,11 @@ ArgsConf::ArgsConf() {
     param_str_["modeldir"] = &modeldir_;
     param_str_["trainfile"] = &trainfile_;
     param_str_["evalfile"] = &evalfile_;
+    param_str_["modelformat"] = &modelformat_;
+    param_str_["numapolicy"] = &numapolicy_;
+    param_str_["threadaffinity"] = &threadaffinity_;
+    param_str_["simd"] = &simd_;
+    param_str_["corpuscachedir"] = &corpuscachedir_;
     // int
     param_int_["minlen"] = &minlen_;
     param_int_["maxlen"] = &maxlen_;
@@ -33,6 +38,15 @@ ArgsConf::ArgsConf() {
     param_int_["getlossevery"] = &getlossevery_;
     param_int_["evalevery"] = &evalevery_;
     param_int_["epoch"] = &epoch_;
+    param_int_["predictthread"] = &predictthread_;
+    param_int_["predictbatch"] = &predictbatch_;
+    param_int_["seed"] = &seed_;
+    param_int_["annlist"] = &annlist_;
+    param_int_["oovcachesize"] = &oovcachesize_;
+    param_int_["annprobe"] = &annprobe_;
+    param_int_["checkpointlines"] = &checkpointlines_;
+    param_int_["checkpointminutes"] = &checkpointminutes_;
+    param_int_["checkpointkeep"] = &checkpointkeep_;
     // float
     param_float_["learnrate"] = &learnrate_;
     param_float_["freqsample"] = &freqsample_;
@@ -41,6 +55,13 @@ ArgsConf::ArgsConf() {
     param_bool_["useskipgram"] = &useskipgram_;
     param_bool_["usecls"] = &usecls_;
     param_bool_["usepair"] = &usepair_;
+    param_bool_["mmapload"] = &mmapload_;
+    param_bool_["annindex"] = &annindex_;
+    param_bool_["oovsubword"] = &oovsubword_;
+    param_bool_["usecorpuscache"] = &usecorpuscache_;
+    param_bool_["deterministic"] = &deterministic_;
+    param_bool_["growvocab"] = &growvocab_;
+    param_bool_["asynceval"] = &asynceval_;
 }
 
 ArgsConf::~ArgsConf() {
@@ -125,6 +146,10 @@ void ArgsConf::PrintArgs() {
     cerr << std::left << setw(30) << "modeldir:" << modeldir_ << endl;
     cerr << std::left << setw(30) << "trainfile:" << trainfile_ << endl;
     cerr << std::left << setw(30) << "evalfile:" << evalfile_ << endl;
+    cerr << std::left << setw(30) << "modelformat:" << modelformat_ << endl;
+    cerr << std::left << setw(30) << "numapolicy:" << numapolicy_ << endl;
+    cerr << std::left << setw(30) << "threadaffinity:" << threadaffinity_ << endl;
+    cerr << std::left << setw(30) << "simd:" << simd_ << endl;
     cerr << std::left << setw(30) << "minlen:" << minlen_ << endl;
     cerr << std::left << setw(30) << "maxlen:" << maxlen_ << endl;
     cerr << std::left << setw(30) << "maxvocabsize:" << maxvocabsize_ << endl;
@@ -139,10 +164,27 @@ void ArgsConf::PrintArgs() {
     cerr << std::left << setw(30) << "useskipgram:" << (useskipgram_ ? "true" : "false") << endl;
     cerr << std::left << setw(30) << "usecls:" << (usecls_ ? "true" : "false") << endl;
     cerr << std::left << setw(30) << "usepair:" << (usepair_ ? "true" : "false") << endl;
+    cerr << std::left << setw(30) << "mmapload:" << (mmapload_ ? "true" : "false") << endl;
+    cerr << std::left << setw(30) << "annindex:" << (annindex_ ? "true" : "false") << endl;
+    cerr << std::left << setw(30) << "annlist:" << annlist_ << endl;
+    cerr << std::left << setw(30) << "annprobe:" << annprobe_ << endl;
+    cerr << std::left << setw(30) << "oovsubword:" << (oovsubword_ ? "true" : "false") << endl;
+    cerr << std::left << setw(30) << "oovcachesize:" << oovcachesize_ << endl;
     cerr << std::left << setw(30) << "thread:" << thread_ << endl;
     cerr << std::left << setw(30) << "getlossevery:" << getlossevery_ << endl;
     cerr << std::left << setw(30) << "evalevery:" << evalevery_ << endl;
     cerr << std::left << setw(30) << "epoch:" << epoch_ << endl;
+    cerr << std::left << setw(30) << "predictthread:" << predictthread_ << endl;
+    cerr << std::left << setw(30) << "predictbatch:" << predictbatch_ << endl;
+    cerr << std::left << setw(30) << "seed:" << seed_ << endl;
+    cerr << std::left << setw(30) << "usecorpuscache:" << (usecorpuscache_ ? "true" : "false") << endl;
+    cerr << std::left << setw(30) << "corpuscachedir:" << corpuscachedir_ << endl;
+    cerr << std::left << setw(30) << "deterministic:" << (deterministic_ ? "true" : "false") << endl;
+    cerr << std::left << setw(30) << "growvocab:" << (growvocab_ ? "true" : "false") << endl;
+    cerr << std::left << setw(30) << "checkpointlines:" << checkpointlines_ << endl;
+    cerr << std::left << setw(30) << "checkpointminutes:" << checkpointminutes_ << endl;
+    cerr << std::left << setw(30) << "checkpointkeep:" << checkpointkeep_ << endl;
+    cerr << std::left << setw(30) << "asynceval:" << (asynceval_ ? "true" : "false") << endl;
     cerr << std::left << setw(30) << "learnrate:" << learnrate_ << endl;
     cerr << std::left << setw(30) << "freqsample:" << freqsample_ << endl;
     cerr << std::left << setw(30) << "dropoutkeeprate:" << dropoutkeeprate_ << endl;
@@ -162,6 +204,20 @@ void ArgsConf::CheckArgs() {
             << endl;
         exit(1);
     }
+    if (modelformat_ != "bin" && modelformat_ != "text") {
+        cerr << "Error: modelformat must be bin or text" << endl;
+        exit(1);
+    }
+    if (numapolicy_ != "none" && numapolicy_ != "interleave"
+        && numapolicy_ != "firsttouch") {
+        cerr << "Error: numapolicy must be none, interleave or firsttouch" << endl;
+        exit(1);
+    }
+    if (threadaffinity_ != "none" && threadaffinity_ != "node"
+        && threadaffinity_ != "core") {
+        cerr << "Error: threadaffinity must be none, node or core" << endl;
+        exit(1);
+    }
     CheckMin(minlen_, 1, "minlen number error");
     CheckMin(maxlen_, 1, "maxlen number error");
     CheckMin(maxvocabsize_, 10000, "maxvocabsize number error");
@@ -177,6 +233,14 @@ void ArgsConf::CheckArgs() {
     CheckMin(getlossevery_, 1, "get loss every number error");
     CheckMin(evalevery_, 1, "evalevery number error");
     CheckMin(epoch_, 1, "epoch number error");
+    CheckMin(predictthread_, 1, "predictthread number error");
+    CheckMin(predictbatch_, 1, "predictbatch number error");
+    CheckMin(annlist_, 0, "annlist number error");
+    CheckMin(annprobe_, 1, "annprobe number error");
+    CheckMin(oovcachesize_, 0, "oovcachesize number error");
+    CheckMin(checkpointlines_, 0, "checkpointlines number error");
+    CheckMin(checkpointminutes_, 0, "checkpointminutes number error");
+    CheckMin(checkpointkeep_, 1, "checkpointkeep number error");
     CheckMin(learnrate_, static_cast<float>(0.0), "learn rate error");
     CheckMin(freqsample_, static_cast<float>(0.0), "learn rate error");
     CheckMin(dropoutkeeprate_, static_cast<float>(0.0), "learn rate error");
@@ -205,4 +269,18 @@ string ArgsConf::GetParamStr(const string &key) {
     }
     return "NULL";
 }
+
+bool ArgsConf::UseMmapLoad() {
+    // training writes the layers, so it always needs its own copy
+    return mmapload_ && process_ != "train";
+}
+
+bool ArgsConf::UseOovSubword() {
+    // the train examples only use the subwords of vocab words
+    return oovsubword_ && process_ != "train";
+}
+
+bool ArgsConf::UseCheckpoint() {
+    return process_ == "train" && (checkpointlines_ > 0 || checkpointminutes_ > 0);
+}
 } // end of namespace knowledgeembedding
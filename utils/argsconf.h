@@ -14,7 +14,7 @@
 
 namespace knowledgeembedding {
     enum class ModelName : int {skip = 1, cls, kb, pair};
-    enum class LossFun : int {ng = 1, softmax};
+    enum class LossFun : int {ng = 1, softmax, hs};
     class ArgsConf {
         public:
             ArgsConf();
@@ -27,6 +27,12 @@ namespace knowledgeembedding {
             void CheckMin(const T &param, T minval, const string &err);
             float GetParamNum(const string &key);
             string GetParamStr(const string &key);
+            // whether layers should be mapped instead of copied
+            bool UseMmapLoad();
+            // whether out of vocab words are looked up by their subwords
+            bool UseOovSubword();
+            // whether train writes checkpoints
+            bool UseCheckpoint();
 
         public: // user set conf
             map<string, string *> param_str_;
@@ -38,6 +44,12 @@ namespace knowledgeembedding {
             string modeldir_ = "";
             string trainfile_ = "";
             string evalfile_ = "";
+            // model file format while saving: bin / text
+            string modelformat_ = "bin";
+            // page placement of the trained matrices: none / interleave / firsttouch
+            string numapolicy_ = "none";
+            // pin train threads: none / node / core
+            string threadaffinity_ = "none";
 
             int minlen_ = 3;
             int maxlen_ = 10000;
@@ -57,6 +69,11 @@ namespace knowledgeembedding {
             int getlossevery_ = 100;
             int evalevery_ = 10000;
             int epoch_ = 1;
+            // predict worker number and lines of one predict batch
+            int predictthread_ = 1;
+            int predictbatch_ = 10000;
+            // seed of the per thread random streams of training
+            int seed_ = 1;
 
             float learnrate_ = 0.05;
             float freqsample_ = 0.0001;
@@ -65,6 +82,38 @@ namespace knowledgeembedding {
             bool useskipgram_ = true;
             bool usecls_ = true;
             bool usepair_ = true;
+            // simd kernels: auto / scalar / sse2 / avx2 / avx512
+            string simd_ = "auto";
+            // mmap binary layers read-only in non-train process
+            bool mmapload_ = false;
+            // distance process: ann index, 0 lists means sqrt(rows),
+            // more probed lists give higher recall
+            bool annindex_ = false;
+            int annlist_ = 0;
+            int annprobe_ = 16;
+            // predict / sentence_vec: out of vocab words add their subwords,
+            // the lists of oovcachesize recent words are cached
+            bool oovsubword_ = false;
+            int oovcachesize_ = 100000;
+            // tokenize the train file once into binary shards when epoch > 1,
+            // the shards take about the size of the train file in
+            // corpuscachedir ($TMPDIR or /tmp if empty)
+            bool usecorpuscache_ = false;
+            string corpuscachedir_ = "";
+            // train threads update the model in turns, in thread order
+            bool deterministic_ = false;
+            // train with modeldir: add the new words of trainfile
+            bool growvocab_ = true;
+            // train: write outputdir/checkpoint_NNNN every checkpointlines
+            // lines or checkpointminutes minutes (0 is off), keep the last
+            // checkpointkeep of them
+            int checkpointlines_ = 0;
+            int checkpointminutes_ = 0;
+            int checkpointkeep_ = 3;
+            // train: score the evalfile every evalevery lines on a copy of
+            // the layers in a low priority thread, with as many examples
+            // as fit in the interval. false evals all of them in thread 0
+            bool asynceval_ = true;
 
         public: // loaded confs
             atomic<uint64_t> totallinenum_;
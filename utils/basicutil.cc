@@ -18,6 +18,10 @@ bool StringToNumber(const string &text, uint32_t *val) {
    *val = atoi(text.c_str());
    return true;
 }
+bool StringToNumber(const string &text, int64_t *val) {
+   *val = atoll(text.c_str());
+   return true;
+}
 void StringTrim(string* str) {
     size_t start_pos = 0;
     size_t end_pos = str->length();
@@ -97,6 +101,39 @@ void TrimVector(vector<string> *str_vec) {
     }
 }
 
+string_view TrimView(string_view str) {
+    size_t start_pos = 0;
+    size_t end_pos = str.size();
+    while (start_pos != end_pos && (str[start_pos] == ' '
+       || str[start_pos] == '\t' || str[start_pos] == '\n')) {
+        start_pos++;
+    }
+    while (end_pos != start_pos && (str[end_pos - 1] == ' '
+       || str[end_pos - 1] == '\t' || str[end_pos - 1] == '\n')) {
+        end_pos--;
+    }
+    return str.substr(start_pos, end_pos - start_pos);
+}
+
+void SplitView(string_view dest_string,
+               char splitor,
+               vector<string_view> &result_vec) {
+    result_vec.clear();
+    size_t start = 0;
+    size_t pos = 0;
+    while ((pos = dest_string.find(splitor, start)) != string_view::npos) {
+        result_vec.push_back(dest_string.substr(start, pos - start));
+        start = pos + 1;
+    }
+    result_vec.push_back(dest_string.substr(start));
+}
+
+void TrimVector(vector<string_view> *str_vec) {
+    for (unsigned int i = 0; i < str_vec->size(); i++) {
+        (*str_vec)[i] = TrimView((*str_vec)[i]);
+    }
+}
+
 bool StartWith(const string &str_source, const string &str_prefix) {
     if (str_source == "" || str_prefix == ""
         || str_prefix.size() > str_source.size()) {
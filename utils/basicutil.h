@@ -23,6 +23,7 @@
 #include <random>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
@@ -48,6 +49,7 @@ using std::shared_ptr;
 using std::streamoff;
 using std::streampos;
 using std::string;
+using std::string_view;
 using std::thread;
 using std::to_string;
 using std::uniform_real_distribution;
@@ -59,6 +61,7 @@ namespace utils {
     bool StringToNumber(const string &text, float *val);
     bool StringToNumber(const string &text, int32_t *val);
     bool StringToNumber(const string &text, uint32_t *val);
+    bool StringToNumber(const string &text, int64_t *val);
     void StringTrim(string* str);
     string StringTrim(const string& str);
     void StringToLower(string* s);
@@ -69,10 +72,48 @@ namespace utils {
                      vector<string> &result_vec);
     // trim string vector
     void TrimVector(vector<string> *str_vec);
+    // string_view versions of trim and split, the results are views into
+    // the input and reuse the capacity of result_vec
+    string_view TrimView(string_view str);
+    void SplitView(string_view dest_string,
+                   char splitor,
+                   vector<string_view> &result_vec);
+    void TrimVector(vector<string_view> *str_vec);
     // judge whether "str_prefix" is prefix of "str_source"
     bool StartWith(const string &str_source, const string &str_prefix);
     // change number to format str
     string GetFormatStr(float num, uint32_t width = 7);
+
+    // random stream of one train thread. the stream is derived from the
+    // global seed and the stream id, so a run with the same seed and
+    // thread number draws the same numbers in every thread
+    class Rng {
+        public:
+            Rng(uint64_t seed = 1, uint64_t stream = 0) : uniform_(0, 1) {
+                // splitmix64 of seed and stream, streams of close seeds differ
+                uint64_t z = seed * 0x9E3779B97F4A7C15ULL + stream + 1;
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                z ^= z >> 31;
+                engine_.seed(static_cast<uint32_t>(z % 2147483646) + 1);
+                rand_long_ = z;
+            }
+            // uniform in [0, 1)
+            float Uniform() { return uniform_(engine_); }
+            // uniform in [min, max], the word2vec linear congruential step
+            int32_t Int(int32_t min, int32_t max) {
+                if (min >= max) {
+                    return min;
+                }
+                rand_long_ = rand_long_ * static_cast<uint64_t>(25214903917) + 11;
+                return (rand_long_ >> 16) % (max - min + 1) + min;
+            }
+
+        private:
+            minstd_rand engine_;
+            uniform_real_distribution<> uniform_;
+            uint64_t rand_long_;
+    };
 } // namespace utils
 } // namespace knowledgeembedding
 
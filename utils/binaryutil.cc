@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#include "binaryutil.h"
+
+namespace knowledgeembedding {
+namespace utils {
+
+bool IsLittleEndian() {
+    uint32_t val = 1;
+    return *reinterpret_cast<uint8_t *>(&val) == 1;
+}
+
+bool IsBinaryFile(const string &file_path) {
+    ifstream fin(file_path, ios::binary);
+    if (!fin.is_open()) {
+        return false;
+    }
+    uint32_t magic = 0;
+    fin.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+    return fin && magic == kBinaryMagic;
+}
+
+void InitBinaryHeader(BinaryKind kind, uint64_t row, uint64_t col,
+                      BinaryHeader *header) {
+    memset(header, 0, sizeof(BinaryHeader));
+    header->magic = kBinaryMagic;
+    header->version = kBinaryVersion;
+    header->kind = static_cast<uint32_t>(kind);
+    header->dtype = static_cast<uint32_t>(DataType::float32);
+    header->row = row;
+    header->col = col;
+    header->offset = sizeof(BinaryHeader);
+}
+
+void WriteBinaryHeader(ofstream &ofs, const BinaryHeader &header) {
+    if (!IsLittleEndian()) {
+        cerr << "Error : binary model format needs a little endian host" << endl;
+        exit(1);
+    }
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(BinaryHeader));
+}
+
+void CheckBinaryHeader(const BinaryHeader &header,
+                       const string &file_path,
+                       BinaryKind kind) {
+    if (!IsLittleEndian()) {
+        cerr << "Error : binary model format needs a little endian host" << endl;
+        exit(1);
+    }
+    if (header.magic != kBinaryMagic) {
+        cerr << "Error : not a binary model file: " << file_path << endl;
+        exit(1);
+    }
+    if (header.version > kBinaryVersion) {
+        cerr << "Error : unsupported binary version(" << header.version
+            << ") of file: " << file_path << endl;
+        exit(1);
+    }
+    if (header.kind != static_cast<uint32_t>(kind)) {
+        cerr << "Error : unexpected binary kind(" << header.kind
+            << ") of file: " << file_path << endl;
+        exit(1);
+    }
+}
+
+void ReadBinaryHeader(ifstream &ifs,
+                      const string &file_path,
+                      BinaryKind kind,
+                      BinaryHeader *header) {
+    ifs.read(reinterpret_cast<char *>(header), sizeof(BinaryHeader));
+    if (!ifs) {
+        cerr << "Error : not a binary model file: " << file_path << endl;
+        exit(1);
+    }
+    CheckBinaryHeader(*header, file_path, kind);
+    ifs.seekg(streampos(header->offset));
+}
+
+void WriteBinaryPadding(ofstream &ofs) {
+    uint64_t pos = uint64_t(ofs.tellp());
+    while (pos % kBinaryAlign != 0) {
+        ofs.put(0);
+        pos++;
+    }
+}
+
+void SkipBinaryPadding(ifstream &ifs) {
+    uint64_t pos = uint64_t(ifs.tellg());
+    if (pos % kBinaryAlign != 0) {
+        ifs.seekg(streampos(pos + kBinaryAlign - pos % kBinaryAlign));
+    }
+}
+
+void WriteBinaryMatrix(const string &outputdir,
+                       const string &filename,
+                       const float *data,
+                       uint32_t row,
+                       uint32_t col) {
+    string file = outputdir + "/" + filename;
+    ofstream ofs(file, ios::binary);
+    if (!ofs.is_open()) {
+        cerr << "Error : cannot create file " + file << endl;
+        assert(ofs.is_open());
+    }
+    BinaryHeader header;
+    InitBinaryHeader(BinaryKind::matrix, row, col, &header);
+    WriteBinaryHeader(ofs, header);
+    WriteBinaryVec(ofs, data, uint64_t(row) * uint64_t(col));
+    CloseOutFile(&ofs);
+}
+
+void ReadBinaryMatrix(const string &file_path,
+                      float **data,
+                      uint32_t *row,
+                      uint32_t *col) {
+    ifstream fin(file_path, ios::binary);
+    assert(fin.is_open());
+    BinaryHeader header;
+    ReadBinaryHeader(fin, file_path, BinaryKind::matrix, &header);
+    if (header.dtype != static_cast<uint32_t>(DataType::float32)) {
+        cerr << "Error : unsupported matrix dtype(" << header.dtype
+            << ") of file: " << file_path << endl;
+        exit(1);
+    }
+    *row = uint32_t(header.row);
+    *col = uint32_t(header.col);
+    assert(*row > 0);
+    assert(*col > 0);
+    uint64_t datasize = header.row * header.col;
+    *data = new float[datasize];
+    ReadBinaryVec(fin, *data, datasize);
+    CloseInFile(&fin);
+}
+
+void WriteBinaryInt8Matrix(const string &outputdir,
+                           const string &filename,
+                           const float *scales,
+                           const int8_t *data,
+                           uint32_t row,
+                           uint32_t col) {
+    string file = outputdir + "/" + filename;
+    ofstream ofs(file, ios::binary);
+    if (!ofs.is_open()) {
+        cerr << "Error : can not open file: " << file << endl;
+        exit(1);
+    }
+    BinaryHeader header;
+    InitBinaryHeader(BinaryKind::matrix, row, col, &header);
+    header.dtype = static_cast<uint32_t>(DataType::int8);
+    uint64_t data_offset = header.offset + uint64_t(row) * sizeof(float);
+    data_offset = (data_offset + kBinaryAlign - 1) / kBinaryAlign * kBinaryAlign;
+    header.extra[0] = data_offset;
+    WriteBinaryHeader(ofs, header);
+    WriteBinaryVec(ofs, scales, row);
+    WriteBinaryPadding(ofs);
+    WriteBinaryVec(ofs, data, uint64_t(row) * uint64_t(col));
+    CloseOutFile(&ofs);
+}
+
+void ReadBinaryInt8Matrix(const string &file_path,
+                          vector<float> *scales,
+                          vector<int8_t> *data,
+                          uint32_t *row,
+                          uint32_t *col) {
+    ifstream fin(file_path, ios::binary);
+    assert(fin.is_open());
+    BinaryHeader header;
+    ReadBinaryHeader(fin, file_path, BinaryKind::matrix, &header);
+    if (header.dtype != static_cast<uint32_t>(DataType::int8)) {
+        cerr << "Error : unsupported int8 matrix dtype(" << header.dtype
+            << ") of file: " << file_path << endl;
+        exit(1);
+    }
+    *row = uint32_t(header.row);
+    *col = uint32_t(header.col);
+    assert(*row > 0);
+    assert(*col > 0);
+    scales->resize(*row);
+    data->resize(uint64_t(*row) * uint64_t(*col));
+    ReadBinaryVec(fin, scales->data(), scales->size());
+    fin.seekg(streampos(header.extra[0]));
+    ReadBinaryVec(fin, data->data(), data->size());
+    CloseInFile(&fin);
+}
+
+void MapBinaryMatrix(const string &file_path,
+                     MappedFile *mapped_file,
+                     float **data,
+                     uint32_t *row,
+                     uint32_t *col) {
+    if (!mapped_file->Open(file_path)) {
+        cerr << "Error : cannot mmap file: " << file_path << endl;
+        exit(1);
+    }
+    if (mapped_file->Size() < sizeof(BinaryHeader)) {
+        cerr << "Error : not a binary model file: " << file_path << endl;
+        exit(1);
+    }
+    const BinaryHeader *header =
+        reinterpret_cast<const BinaryHeader *>(mapped_file->Data());
+    CheckBinaryHeader(*header, file_path, BinaryKind::matrix);
+    if (header->dtype != static_cast<uint32_t>(DataType::float32)) {
+        cerr << "Error : unsupported matrix dtype(" << header->dtype
+            << ") of file: " << file_path << endl;
+        exit(1);
+    }
+    uint64_t datasize = header->row * header->col * sizeof(float);
+    if (header->offset % kBinaryAlign != 0
+        || header->offset + datasize > mapped_file->Size()) {
+        cerr << "Error : binary matrix is not aligned or truncated: "
+            << file_path << endl;
+        exit(1);
+    }
+    *row = uint32_t(header->row);
+    *col = uint32_t(header->col);
+    assert(*row > 0);
+    assert(*col > 0);
+    // the mapping is read-only, writing through *data faults
+    *data = reinterpret_cast<float *>(
+                const_cast<char *>(mapped_file->Data()) + header->offset);
+}
+
+void MapBinaryInt32(const string &file_path,
+                    BinaryKind kind,
+                    MappedFile *mapped_file,
+                    const int32_t **data,
+                    uint64_t *size) {
+    if (!mapped_file->Open(file_path)) {
+        cerr << "Error : cannot mmap file: " << file_path << endl;
+        exit(1);
+    }
+    if (mapped_file->Size() < sizeof(BinaryHeader)) {
+        cerr << "Error : not a binary model file: " << file_path << endl;
+        exit(1);
+    }
+    const BinaryHeader *header =
+        reinterpret_cast<const BinaryHeader *>(mapped_file->Data());
+    CheckBinaryHeader(*header, file_path, kind);
+    if (header->dtype != static_cast<uint32_t>(DataType::int32)) {
+        cerr << "Error : unsupported int32 stream dtype(" << header->dtype
+            << ") of file: " << file_path << endl;
+        exit(1);
+    }
+    if (header->offset % kBinaryAlign != 0
+        || header->offset + header->col * sizeof(int32_t) > mapped_file->Size()) {
+        cerr << "Error : binary int32 stream is not aligned or truncated: "
+            << file_path << endl;
+        exit(1);
+    }
+    *size = header->col;
+    *data = reinterpret_cast<const int32_t *>(mapped_file->Data() + header->offset);
+}
+} // namespace utils
+} // namespace knowledgeembedding
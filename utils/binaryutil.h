@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#ifndef KNOWLEDGE_EMBEDDING_UTILS_BINARYUTIL_H
+#define KNOWLEDGE_EMBEDDING_UTILS_BINARYUTIL_H
+
+#include <string>
+#include <vector>
+
+#include "basicutil.h"
+#include "fileutil.h"
+
+namespace knowledgeembedding {
+namespace utils {
+    // "KEMB" in little endian
+    const uint32_t kBinaryMagic = 0x424d454b;
+    const uint32_t kBinaryVersion = 1;
+    // every data block starts at a multiple of kBinaryAlign bytes
+    const uint64_t kBinaryAlign = 64;
+
+    enum class BinaryKind : uint32_t {matrix = 1, vocab, corpus, ann};
+    enum class DataType : uint32_t {float32 = 1, int32, int8};
+
+    // fixed 64 bytes header of every binary model file
+    struct BinaryHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t kind;
+        uint32_t dtype;
+        uint64_t row;
+        uint64_t col;
+        // byte offset of the first data block
+        uint64_t offset;
+        // kind specific values
+        uint64_t extra[3];
+    };
+    static_assert(sizeof(BinaryHeader) == kBinaryAlign,
+                  "binary header must be 64 bytes");
+
+    bool IsLittleEndian();
+    // judge whether the file starts with a binary model header
+    bool IsBinaryFile(const string &file_path);
+    void InitBinaryHeader(BinaryKind kind, uint64_t row, uint64_t col,
+                          BinaryHeader *header);
+    void WriteBinaryHeader(ofstream &ofs, const BinaryHeader &header);
+    // check magic/version/kind, exit if the file is not valid
+    void CheckBinaryHeader(const BinaryHeader &header,
+                           const string &file_path,
+                           BinaryKind kind);
+    // read and check the header, exit if the file is not valid
+    void ReadBinaryHeader(ifstream &ifs,
+                          const string &file_path,
+                          BinaryKind kind,
+                          BinaryHeader *header);
+    // write zero bytes until the stream position is aligned
+    void WriteBinaryPadding(ofstream &ofs);
+    void SkipBinaryPadding(ifstream &ifs);
+    template<typename T>
+    void WriteBinaryVec(ofstream &ofs, const T *data, uint64_t size) {
+        ofs.write(reinterpret_cast<const char *>(data), sizeof(T) * size);
+    }
+    template<typename T>
+    void ReadBinaryVec(ifstream &ifs, T *data, uint64_t size) {
+        ifs.read(reinterpret_cast<char *>(data), sizeof(T) * size);
+        if (!ifs) {
+            cerr << "Error : binary file is truncated" << endl;
+            exit(1);
+        }
+    }
+    // row-major float matrix: header + raw little endian floats
+    void WriteBinaryMatrix(const string &outputdir,
+                           const string &filename,
+                           const float *data,
+                           uint32_t row,
+                           uint32_t col);
+    // allocate *data with new float[] and fill it from file
+    void ReadBinaryMatrix(const string &file_path,
+                          float **data,
+                          uint32_t *row,
+                          uint32_t *col);
+    // int8 matrix with a float scale per row, row i is scales[i] * data[i]:
+    // header + row floats + padding + row * col int8, extra[0] is the byte
+    // offset of the int8 block
+    void WriteBinaryInt8Matrix(const string &outputdir,
+                               const string &filename,
+                               const float *scales,
+                               const int8_t *data,
+                               uint32_t row,
+                               uint32_t col);
+    void ReadBinaryInt8Matrix(const string &file_path,
+                              vector<float> *scales,
+                              vector<int8_t> *data,
+                              uint32_t *row,
+                              uint32_t *col);
+    // point *data into a read-only mapping of the file, the pages are
+    // shared with every process mapping the same file
+    void MapBinaryMatrix(const string &file_path,
+                         MappedFile *mapped_file,
+                         float **data,
+                         uint32_t *row,
+                         uint32_t *col);
+    // point *data into a read-only mapping of an int32 stream of kind,
+    // the header col is the number of values, *size is set to it
+    void MapBinaryInt32(const string &file_path,
+                        BinaryKind kind,
+                        MappedFile *mapped_file,
+                        const int32_t **data,
+                        uint64_t *size);
+
+    // reads the values of an int32 stream in order
+    class Int32Reader {
+        public:
+            Int32Reader(const int32_t *data = NULL, uint64_t size = 0)
+                : data_(data), size_(size), pos_(0) {}
+            // return false after the last value
+            bool Next(int32_t *val) {
+                if (pos_ >= size_) {
+                    return false;
+                }
+                *val = data_[pos_++];
+                return true;
+            }
+            // copy the next size values into vec
+            bool Next(uint32_t size, vector<int32_t> *vec) {
+                if (pos_ + size > size_) {
+                    return false;
+                }
+                vec->assign(data_ + pos_, data_ + pos_ + size);
+                pos_ += size;
+                return true;
+            }
+            void Rewind() { pos_ = 0; }
+
+        private:
+            const int32_t *data_;
+            uint64_t size_;
+            uint64_t pos_;
+    };
+} // namespace utils
+} // namespace knowledgeembedding
+#endif // KNOWLEDGE_EMBEDDING_UTILS_BINARYUTIL_H
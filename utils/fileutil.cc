@@ -4,6 +4,10 @@
  */
 #include "fileutil.h"
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
 namespace knowledgeembedding {
 namespace utils {
 
@@ -60,6 +64,26 @@ void CloseInFile(ifstream *ifs) {
     ifs->close();
 }
 
+bool MakeDir(const string &dir) {
+    return mkdir(dir.c_str(), S_IRWXU | S_IRWXG | S_IRWXO) == 0 || access(dir.c_str(), 0) == 0;
+}
+
+void RemoveDir(const string &dir) {
+    DIR *handle = opendir(dir.c_str());
+    if (handle == NULL) {
+        return;
+    }
+    struct dirent *entry = NULL;
+    while ((entry = readdir(handle)) != NULL) {
+        string name = entry->d_name;
+        if (name != "." && name != "..") {
+            unlink((dir + "/" + name).c_str());
+        }
+    }
+    closedir(handle);
+    rmdir(dir.c_str());
+}
+
 uint64_t GetFileLineNumber(const string &file_path) {
     ifstream fin(file_path);
     if (!fin.is_open()) {
@@ -75,5 +99,99 @@ uint64_t GetFileLineNumber(const string &file_path) {
     return line_counter;
 }
 
+void SplitFileByLine(const string &file_path,
+                     int32_t part_num,
+                     vector<pair<int64_t, int64_t>> &ranges) {
+    assert(part_num > 0);
+    ifstream fin(file_path);
+    if (!fin.is_open()) {
+        cerr << "can not open file: " << file_path << endl;
+        assert(fin.is_open());
+    }
+    int64_t size = Size(&fin);
+    vector<int64_t> begins(part_num + 1, 0);
+    begins[part_num] = size;
+    string line;
+    for (int32_t i = 1; i < part_num; i++) {
+        int64_t pos = size * i / part_num;
+        begins[i] = max(pos, begins[i - 1]);
+        if (pos <= begins[i - 1] || pos >= size) {
+            continue;
+        }
+        // the part begins after the line holding byte pos - 1
+        Seek(&fin, pos - 1);
+        getline(fin, line);
+        begins[i] = fin.fail() || fin.eof() ? size : int64_t(fin.tellg());
+    }
+    ranges.clear();
+    for (int32_t i = 0; i < part_num; i++) {
+        ranges.push_back(make_pair(begins[i], begins[i + 1]));
+    }
+    fin.close();
+}
+
+MappedFile::MappedFile(): data_(NULL), size_(0) {
+}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const string &file_path) {
+    Close();
+    int fd = open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps its own reference of the file
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    data_ = reinterpret_cast<char *>(addr);
+    size_ = uint64_t(st.st_size);
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data_ != NULL) {
+        munmap(data_, size_);
+    }
+    data_ = NULL;
+    size_ = 0;
+}
+void MappedFile::AdviseSequential() {
+    if (data_ != NULL) {
+        madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+}
+
+LineReader::LineReader(const MappedFile &file, int64_t begin, int64_t end):
+    data_(file.Data()),
+    size_(file.Size()),
+    begin_(uint64_t(begin)),
+    end_(min(uint64_t(end), file.Size())),
+    pos_(uint64_t(begin)) {
+    assert(begin >= 0 && begin <= end);
+}
+
+bool LineReader::Next(string_view *line) {
+    if (pos_ >= end_) {
+        return false;
+    }
+    const char *start = data_ + pos_;
+    const char *stop = reinterpret_cast<const char *>(
+                memchr(start, '\n', size_ - pos_));
+    uint64_t len = stop == NULL ? size_ - pos_ : uint64_t(stop - start);
+    *line = string_view(start, len);
+    pos_ += len + 1;
+    return true;
+}
 } // namespace utils
 } // namespace knowledgeembedding
@@ -6,6 +6,8 @@
 #define KNOWLEDGE_EMBEDDING_UTILS_FILEUTIL_H
 
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "basicutil.h"
 
@@ -22,6 +24,56 @@ namespace utils {
     void CloseOutFile(ofstream *ofs);
     void CloseInFile(ifstream *ifs);
     uint64_t GetFileLineNumber(const string &file_path);
+    // mkdir, true if the directory exists afterwards
+    bool MakeDir(const string &dir);
+    // remove a directory of plain files
+    void RemoveDir(const string &dir);
+    // split the file into part_num byte ranges [begin, end), every range
+    // begins at the start of a line and a line belongs to the range
+    // holding its first byte, so each line is read by exactly one part
+    void SplitFileByLine(const string &file_path,
+                         int32_t part_num,
+                         vector<pair<int64_t, int64_t>> &ranges);
+
+    // read-only mmap of a whole file
+    class MappedFile {
+        public:
+            MappedFile();
+            ~MappedFile();
+            bool Open(const string &file_path);
+            void Close();
+            const char* Data() const { return data_; }
+            uint64_t Size() const { return size_; }
+            // tell the kernel the file is read from begin to end
+            void AdviseSequential();
+
+        private:
+            MappedFile(const MappedFile &);
+            MappedFile& operator=(const MappedFile &);
+
+        private:
+            char* data_;
+            uint64_t size_;
+    };
+
+    // lines of the byte range [begin, end) of a mapped file, begin must be
+    // the start of a line (see SplitFileByLine). the lines are views into
+    // the mapping without the '\n' and stay valid while the file is open
+    class LineReader {
+        public:
+            LineReader(const MappedFile &file, int64_t begin, int64_t end);
+            // return false after the last line of the range
+            bool Next(string_view *line);
+            // read the range again from begin
+            void Rewind() { pos_ = begin_; }
+
+        private:
+            const char* data_;
+            uint64_t size_;
+            uint64_t begin_;
+            uint64_t end_;
+            uint64_t pos_;
+    };
 } // namespace utils
 } // namespace knowledgeembedding
 #endif // KNOWLEDGE_EMBEDDING_UTILS_FILEUTIL_H
@@ -5,25 +5,67 @@
 
 #include "hashtable.h"
 
+#include <functional>
+#include <unordered_map>
+
 namespace knowledgeembedding {
+namespace {
+// the first appearance of a word among the merged tables
+struct MergeItem {
+    uint32_t table;
+    uint32_t pos;
+    double freq;
+};
+} // namespace
 
-HashTable::HashTable(shared_ptr<ArgsConf> args_conf, int vocab_size):
+HashTable::HashTable(shared_ptr<ArgsConf> args_conf,
+                     int vocab_size,
+                     bool growable):
     args_conf_(args_conf),
     wordidx_(vocab_size, -1),
-    rng_(vocab_size),
-    uniform_(0, 1) {
-    wordvec_.clear();
+    growable_(growable) {
+    Clear();
     max_vocab_size_ = vocab_size;
     wordsize_ = 0;
     word_filter_freq_ = 1;
 }
 
 HashTable::~HashTable() {
-    wordvec_.clear();
+    Clear();
     wordidx_.clear();
 }
 
-void HashTable::GetSubWordList(const string &word,
+void HashTable::Clear() {
+    arena_.clear();
+    word_offsets_.assign(1, 0);
+    freqs_.clear();
+    subword_offsets_.assign(1, 0);
+    subwords_.clear();
+}
+
+void HashTable::PushWord(string_view word,
+                         float freq,
+                         const vector<int32_t> &subwords) {
+    arena_.append(word);
+    word_offsets_.push_back(arena_.size());
+    freqs_.push_back(freq);
+    subwords_.insert(subwords_.end(), subwords.begin(), subwords.end());
+    subword_offsets_.push_back(subwords_.size());
+}
+
+void HashTable::SetSubwords(uint32_t pos, const vector<int32_t> &subwords) {
+    // cheap for the last entry, an inner entry shifts the lists after it
+    uint64_t begin = subword_offsets_[pos];
+    uint64_t end = subword_offsets_[pos + 1];
+    int64_t diff = int64_t(subwords.size()) - int64_t(end - begin);
+    subwords_.erase(subwords_.begin() + begin, subwords_.begin() + end);
+    subwords_.insert(subwords_.begin() + begin, subwords.begin(), subwords.end());
+    for (uint64_t i = pos + 1; i < subword_offsets_.size(); i++) {
+        subword_offsets_[i] += diff;
+    }
+}
+
+void HashTable::GetSubWordList(string_view word,
                                vector<int32_t> &subword_list,
                                uint32_t subngram,
                                bool is_build_hash_table,
@@ -33,13 +75,15 @@ void HashTable::GetSubWordList(const string &word,
     // chech if already record subword
     int32_t pos = GetWordPos(word);
     if (pos >= 0 && is_build_hash_table == false) {
-        subword_list.insert(subword_list.end(), wordvec_[pos].subwords.begin(),
-                    wordvec_[pos].subwords.end());
+        SubwordSpan subwords = Subwords(pos);
+        subword_list.insert(subword_list.end(), subwords.begin(), subwords.end());
         return;
     }
 
     // compute subword from word str
-    string token = "<" + word + ">>";
+    string token = "<";
+    token.append(word);
+    token += ">>";
     for (uint32_t i = 0; i < token.size(); i++) {
         // jump the middle char
         if ((token[i]& 0xC0) == 0x80) continue;
@@ -88,7 +132,7 @@ void HashTable::GetSubWordList(const vector<string> &word_list,
     }
 }
 
-uint32_t HashTable::GetWordHash(const string &word) {
+uint32_t HashTable::GetWordHash(string_view word) {
     uint32_t h = 2166136261;
     for (uint32_t i = 0; i < word.size(); i++) {
         h = h ^ uint32_t(word[i]);
@@ -97,17 +141,22 @@ uint32_t HashTable::GetWordHash(const string &word) {
     return h % max_vocab_size_;
 }
 
-uint32_t HashTable::GetWordIdx(const string &word) {
+uint32_t HashTable::GetWordIdx(string_view word) {
     uint32_t hval = GetWordHash(word);
-    while (wordidx_[hval] >= 0 && wordvec_[wordidx_[hval]].word != word) {
+    while (wordidx_[hval] >= 0 && Word(wordidx_[hval]) != word) {
         hval = (hval + 1) % max_vocab_size_;
     }
     return hval;
 }
 
-int32_t HashTable::GetWordPos(const string &word) {
+int32_t HashTable::GetWordPos(string_view word) {
+    if (frozen_) {
+        // one hash and at most one compare
+        int32_t pos = perfect_hash_.Find(word);
+        return (pos >= 0 && Word(pos) == word) ? pos : -1;
+    }
     uint32_t idx = GetWordIdx(word);
-    if (wordidx_[idx] >= 0 && uint32_t(wordidx_[idx]) < wordvec_.size()) {
+    if (wordidx_[idx] >= 0 && uint32_t(wordidx_[idx]) < Size()) {
         return wordidx_[idx];
     }
     return -1;
@@ -125,59 +174,87 @@ void HashTable::GetWordPos(const vector<string> &words,
     }
 }
 
-float HashTable::GetWordFreq(const string &word) {
+void HashTable::GetWordPos(const vector<string_view> &words,
+                           vector<int32_t> &idx_vec,
+                           bool keepout) {
+    idx_vec.clear();
+    for (uint32_t i = 0; i < words.size(); i++) {
+        int32_t pos = GetWordPos(words[i]);
+        if (pos >= 0 || keepout) {
+            idx_vec.push_back(pos);
+        }
+    }
+}
+
+float HashTable::GetWordFreq(string_view word) {
+    if (frozen_) {
+        int32_t pos = GetWordPos(word);
+        return pos >= 0 ? freqs_[pos] : 0.0;
+    }
     uint32_t idx = GetWordIdx(word);
     if (wordidx_[idx] >= 0) {
-        return wordvec_[wordidx_[idx]].freq;
+        return freqs_[wordidx_[idx]];
     }
     return 0.0;
 }
 
-bool HashTable::HasWord(const string &word) {
+bool HashTable::HasWord(string_view word) {
+    if (frozen_) {
+        return GetWordPos(word) >= 0;
+    }
     uint32_t idx = GetWordIdx(word);
     return wordidx_[idx] >= 0;
 }
 
-void HashTable::AddWord(const string &word_ori,
+void HashTable::AddWord(string_view word_ori,
                         float default_freq,
                         bool enable_rebuild,
                         bool add_freq,
                         bool add_subword) {
-    string word = word_ori;
-    utils::StringTrim(&word);
-    if (word == "") {
+    string_view word = utils::TrimView(word_ori);
+    if (word.empty()) {
         return;
     }
+    if (frozen_) {
+        cerr << "Error : can not add word " << word << " to a frozen hash table" << endl;
+        exit(1);
+    }
     uint32_t idx = GetWordIdx(word);
     if (wordidx_[idx] >= 0) {
         if (add_freq == true) {
             // add word frequence
-            wordvec_[wordidx_[idx]].freq += default_freq;
+            freqs_[wordidx_[idx]] += default_freq;
             // add subword frequence
             if (add_subword) {
-                for (auto subidx : wordvec_[wordidx_[idx]].subwords) {
-                    wordvec_[subidx].freq += default_freq;
+                for (auto subidx : Subwords(wordidx_[idx])) {
+                    freqs_[subidx] += default_freq;
                 }
             }
         }
     } else {
-        Item item;
-        item.word = word;
-        item.freq = default_freq;
+        // GetSubWordList adds the new subwords before the word
+        vector<int32_t> subwords;
         if (add_subword) {
-            GetSubWordList(word, item.subwords, args_conf_->subngram_, true);
-            // cerr << word << "\t" << item.subwords.size() << endl;
-            for (auto subidx : item.subwords) {
-                wordvec_[subidx].freq += default_freq;
+            GetSubWordList(word, subwords, args_conf_->subngram_, true);
+            for (auto subidx : subwords) {
+                freqs_[subidx] += default_freq;
             }
         }
 
-        wordvec_.push_back(item);
+        if (add_subword) {
+            // the new subwords may take the slot or grow the table
+            idx = GetWordIdx(word);
+        }
+        PushWord(word, default_freq, subwords);
         wordidx_[idx] = wordsize_;
         wordsize_++;
-        if (wordsize_ > 0.7 * max_vocab_size_ && enable_rebuild) {
-            word_filter_freq_++;
-            Rebuild(word_filter_freq_);
+        if (wordsize_ > 0.7 * max_vocab_size_) {
+            if (growable_) {
+                Reindex(2 * max_vocab_size_);
+            } else if (enable_rebuild) {
+                word_filter_freq_++;
+                Rebuild(word_filter_freq_);
+            }
         }
     }
 }
@@ -188,55 +265,101 @@ void HashTable::AddWord(const vector<string> &word_list, bool add_subword) {
     }
 }
 
+void HashTable::AddWord(const vector<string_view> &word_list, bool add_subword) {
+    for (uint32_t i = 0; i < word_list.size(); i++) {
+        AddWord(word_list[i], 1, true, true, add_subword);
+    }
+}
+
+void HashTable::Reindex(uint32_t vocab_size) {
+    max_vocab_size_ = vocab_size;
+    wordidx_.assign(vocab_size, -1);
+    for (uint32_t i = 0; i < Size(); i++) {
+        uint32_t idx = GetWordIdx(Word(i));
+        wordidx_[idx] = i;
+    }
+}
+
+void HashTable::Compact(const vector<uint32_t> &order) {
+    string arena;
+    vector<uint64_t> word_offsets(1, 0);
+    vector<float> freqs;
+    vector<uint64_t> subword_offsets(1, 0);
+    vector<int32_t> subwords;
+    word_offsets.reserve(order.size() + 1);
+    freqs.reserve(order.size());
+    subword_offsets.reserve(order.size() + 1);
+    for (auto pos : order) {
+        arena.append(Word(pos));
+        word_offsets.push_back(arena.size());
+        freqs.push_back(freqs_[pos]);
+        SubwordSpan span = Subwords(pos);
+        subwords.insert(subwords.end(), span.begin(), span.end());
+        subword_offsets.push_back(subwords.size());
+    }
+    arena.shrink_to_fit();
+    subwords.shrink_to_fit();
+    arena_.swap(arena);
+    word_offsets_.swap(word_offsets);
+    freqs_.swap(freqs);
+    subword_offsets_.swap(subword_offsets);
+    subwords_.swap(subwords);
+}
+
 void HashTable::Rebuild(int min_word_freq) {
-    if (min_word_freq > 0) {
-        wordvec_.erase(remove_if(wordvec_.begin(), wordvec_.end(),
-                        [&](const Item &e) {
-                            return static_cast<int>(e.freq) < min_word_freq;
-                        }),
-            wordvec_.end());
-    }
-    wordvec_.shrink_to_fit();
-    stable_sort(wordvec_.begin(), wordvec_.end(),
-                [](const Item &e1, const Item &e2) {
-                    return e1.freq > e2.freq;
+    if (frozen_) {
+        cerr << "Error : can not rebuild a frozen hash table" << endl;
+        exit(1);
+    }
+    // sort the positions, the entries are copied once in the new order
+    vector<uint32_t> order;
+    order.reserve(Size());
+    for (uint32_t i = 0; i < Size(); i++) {
+        if (min_word_freq <= 0 || static_cast<int>(freqs_[i]) >= min_word_freq) {
+            order.push_back(i);
+        }
+    }
+    stable_sort(order.begin(), order.end(),
+                [&](uint32_t e1, uint32_t e2) {
+                    return freqs_[e1] > freqs_[e2];
             });
-    fill(wordidx_.begin(), wordidx_.end(), -1);
-    wordsize_ = wordvec_.size();
+    Compact(order);
+    wordsize_ = Size();
     // rebuild word index
-    for (uint32_t i = 0; i < wordvec_.size(); i++) {
-        uint32_t idx = GetWordIdx(wordvec_[i].word);
-        wordidx_[idx] = i;
-    }
-    wordsize_ = wordvec_.size();
-    // rebuild subword index
-    for (uint32_t i = 0; i < wordvec_.size(); i++) {
-        if (wordvec_[i].subwords.size() <= 0) {
-            continue;
+    Reindex(max_vocab_size_);
+    // rebuild subword index, the old lists only mark the words with subwords
+    vector<uint64_t> subword_offsets(1, 0);
+    vector<int32_t> subwords;
+    vector<int32_t> word_subwords;
+    subword_offsets.reserve(Size() + 1);
+    for (uint32_t i = 0; i < Size(); i++) {
+        if (!Subwords(i).empty()) {
+            GetSubWordList(Word(i), word_subwords, args_conf_->subngram_, true, false);
+            subwords.insert(subwords.end(), word_subwords.begin(), word_subwords.end());
         }
-        GetSubWordList(wordvec_[i].word, wordvec_[i].subwords,
-                       args_conf_->subngram_, true, false);
+        subword_offsets.push_back(subwords.size());
     }
-    wordsize_ = wordvec_.size();
+    subword_offsets_.swap(subword_offsets);
+    subwords_.swap(subwords);
     train_words_ = 0;
-    for (uint32_t i = 0; i < wordvec_.size(); i++) {
-        train_words_ += wordvec_[i].freq;
+    for (uint32_t i = 0; i < Size(); i++) {
+        train_words_ += freqs_[i];
     }
 }
 
 void HashTable::InitDiscardTable(float freq_sample) {
     hash_freq_sample_ = freq_sample;
     uint64_t total = 0;
-    for (uint32_t i = 0; i < wordvec_.size(); i++) {
-        total += uint64_t(wordvec_[i].freq);
+    for (uint32_t i = 0; i < Size(); i++) {
+        total += uint64_t(freqs_[i]);
     }
     train_words_ = total;
     discard_table_.clear();
     if (total <= 0) {
         return;
     }
-    for (uint32_t i = 0; i < wordvec_.size(); i++) {
-        float rate = wordvec_[i].freq / total;
+    for (uint32_t i = 0; i < Size(); i++) {
+        float rate = freqs_[i] / total;
         float disrate = sqrt(freq_sample / rate) + freq_sample / rate;
         discard_table_.push_back(disrate);
     }
@@ -251,7 +374,7 @@ float HashTable::GetDiscardRate(uint32_t wordpos, float boost_freq_sample) {
             return 1; // key all word
         }
         float freq_sample = hash_freq_sample_ * boost_freq_sample;
-        float rate = wordvec_[wordpos].freq / train_words_;
+        float rate = freqs_[wordpos] / train_words_;
         float disrate = sqrt(freq_sample / rate) + freq_sample / rate;
         return disrate;
     }
@@ -259,6 +382,7 @@ float HashTable::GetDiscardRate(uint32_t wordpos, float boost_freq_sample) {
 }
 
 void HashTable::RandomDiscard(vector<int32_t> *word_idx_vec,
+                              utils::Rng *rng,
                               float boost_freq_sample) {
     if (boost_freq_sample < 0.99 || boost_freq_sample > 1.01) {
         if (train_words_ <= 0) {
@@ -267,40 +391,55 @@ void HashTable::RandomDiscard(vector<int32_t> *word_idx_vec,
         float freq_sample = hash_freq_sample_ * boost_freq_sample;
         word_idx_vec->erase(remove_if(word_idx_vec->begin(), word_idx_vec->end(),
                 [&](int32_t idx) {
-                    float rate = wordvec_[idx].freq / train_words_;
+                    float rate = freqs_[idx] / train_words_;
                     float disrate = sqrt(freq_sample / rate) + freq_sample / rate;
-                    return uniform_(rng_) > disrate;
+                    return rng->Uniform() > disrate;
                 }),
             word_idx_vec->end());
     } else {
         word_idx_vec->erase(remove_if(word_idx_vec->begin(), word_idx_vec->end(),
                 [&](int32_t idx) {
-                    return uniform_(rng_) > discard_table_[idx];
+                    return rng->Uniform() > discard_table_[idx];
                 }),
             word_idx_vec->end());
     }
-    word_idx_vec->shrink_to_fit();
 }
 
 void HashTable::RandomDiscard(vector<string> *words,
                                 vector<int32_t> &word_idx_vec,
+                                utils::Rng *rng,
                                 float boost_freq_sample) {
     GetWordPos(*words, word_idx_vec, true);
+    DiscardWordIdx(word_idx_vec, rng, boost_freq_sample);
+}
+
+void HashTable::DiscardWordIdx(vector<int32_t> &word_idx_vec,
+                               utils::Rng *rng,
+                               float boost_freq_sample) {
     if (boost_freq_sample < 0.99 || boost_freq_sample > 1.01) {
         if (train_words_ <= 0) {
             return;
         }
         float freq_sample = hash_freq_sample_ * boost_freq_sample;
         for (uint32_t i = 0; i < word_idx_vec.size(); i++) {
-            float rate = wordvec_[word_idx_vec[i]].freq / train_words_;
+            // out of vocab words are -1 already
+            int32_t idx = word_idx_vec[i];
+            if (idx < 0 || static_cast<uint32_t>(idx) >= Size()) {
+                continue;
+            }
+            float rate = freqs_[idx] / train_words_;
             float disrate = sqrt(freq_sample / rate) + freq_sample / rate;
-            if (uniform_(rng_) > disrate) {
+            if (rng->Uniform() > disrate) {
                 word_idx_vec[i] = -1;
             }
         }
     } else {
         for (uint32_t i = 0; i < word_idx_vec.size(); i++) {
-            if (uniform_(rng_) > discard_table_[i]) {
+            int32_t idx = word_idx_vec[i];
+            if (idx < 0 || static_cast<uint32_t>(idx) >= discard_table_.size()) {
+                continue;
+            }
+            if (rng->Uniform() > discard_table_[idx]) {
                 word_idx_vec[i] = -1;
             }
         }
@@ -315,37 +454,162 @@ void HashTable::PrintHashTable() {
         }
     }
     cerr << "----------- data ---------------" << endl;
-    for (uint32_t i = 0; i < wordvec_.size(); i++) {
-        cerr << i << "\t" << wordvec_[i].word << "\t" << wordvec_[i].freq << endl;
+    for (uint32_t i = 0; i < Size(); i++) {
+        cerr << i << "\t" << Word(i) << "\t" << freqs_[i] << endl;
     }
     cerr << "--------------------------------" << endl;
 }
 
-void HashTable::CombineWordVec(const vector<Item> &word_vec) {
-    for (uint32_t i = 0; i < word_vec.size(); i++) {
-        Item item = word_vec[i];
-        AddWord(item.word, item.freq);
-        if (item.subwords.size() > 0) {
-            int32_t pos = GetWordPos(item.word);
+void HashTable::CombineWordVec(const HashTable &table) {
+    vector<int32_t> subwords;
+    for (uint32_t i = 0; i < table.Size(); i++) {
+        string_view word = table.Word(i);
+        AddWord(word, table.Freq(i));
+        if (!table.Subwords(i).empty()) {
+            int32_t pos = GetWordPos(word);
             if (pos >= 0) {
-                wordvec_[pos].subwords.push_back(0);
+                // a mark for Rebuild to compute the subwords
+                SubwordSpan span = Subwords(pos);
+                subwords.assign(span.begin(), span.end());
+                subwords.push_back(0);
+                SetSubwords(pos, subwords);
             }
         }
     }
 }
 
+void HashTable::Append(const HashTable &table) {
+    uint32_t old_size = Size();
+    vector<bool> has_subwords;
+    for (uint32_t i = 0; i < table.Size(); i++) {
+        // appending never rebuilds, a full index would probe forever
+        if (wordsize_ + 1 > 0.9 * max_vocab_size_) {
+            cerr << "Error : the vocab of the loaded model is full ("
+                << max_vocab_size_ << "), train a new model with larger "
+                << "maxvocabsize / maxphrasesize" << endl;
+            exit(1);
+        }
+        AddWord(table.Word(i), table.Freq(i), false);
+        if (Size() - old_size > has_subwords.size()) {
+            has_subwords.push_back(!table.Subwords(i).empty());
+        }
+    }
+    // the new entries are at the end, their subwords are looked up once
+    // all new subwords are in
+    subword_offsets_.resize(old_size + 1);
+    subwords_.resize(subword_offsets_[old_size]);
+    vector<int32_t> word_subwords;
+    for (uint32_t pos = old_size; pos < Size(); pos++) {
+        if (has_subwords[pos - old_size]) {
+            GetSubWordList(Word(pos), word_subwords, args_conf_->subngram_, true, false);
+            subwords_.insert(subwords_.end(), word_subwords.begin(), word_subwords.end());
+        }
+        subword_offsets_.push_back(subwords_.size());
+    }
+}
+
+void HashTable::Merge(const vector<shared_ptr<HashTable>> &tables,
+                      int32_t thread_num,
+                      bool add_subword) {
+    assert(Size() == 0);
+    uint32_t vocab_size = max_vocab_size_;
+    bool growable = growable_;
+    uint32_t shard_num = uint32_t(max(thread_num, 1));
+    // bucket the words of every table by shard
+    vector<vector<vector<uint32_t>>> buckets(tables.size(),
+                vector<vector<uint32_t>>(shard_num));
+    vector<thread> threads;
+    for (uint32_t t = 0; t < tables.size(); t++) {
+        threads.push_back(thread([&, t]() {
+            const HashTable &table = *tables[t];
+            for (uint32_t i = 0; i < table.Size(); i++) {
+                buckets[t][GetWordHash(table.Word(i)) % shard_num].push_back(i);
+            }
+        }));
+    }
+    for (auto it = threads.begin(); it != threads.end(); it++) {
+        it->join();
+    }
+    threads.clear();
+
+    // sum the frequence of every shard, keep the first appearance
+    vector<vector<MergeItem>> shards(shard_num);
+    for (uint32_t s = 0; s < shard_num; s++) {
+        threads.push_back(thread([&, s]() {
+            // the keys are views into the arenas of the tables
+            std::unordered_map<string_view, uint32_t> index;
+            for (uint32_t t = 0; t < tables.size(); t++) {
+                const HashTable &table = *tables[t];
+                for (auto pos : buckets[t][s]) {
+                    string_view word = table.Word(pos);
+                    auto it = index.find(word);
+                    if (it == index.end()) {
+                        index[word] = shards[s].size();
+                        MergeItem item = {t, pos, table.Freq(pos)};
+                        shards[s].push_back(item);
+                    } else {
+                        shards[s][it->second].freq += table.Freq(pos);
+                    }
+                }
+            }
+        }));
+    }
+    for (auto it = threads.begin(); it != threads.end(); it++) {
+        it->join();
+    }
+
+    vector<MergeItem> items;
+    for (uint32_t s = 0; s < shard_num; s++) {
+        items.insert(items.end(), shards[s].begin(), shards[s].end());
+        vector<MergeItem>().swap(shards[s]);
+    }
+    sort(items.begin(), items.end(),
+         [](const MergeItem &e1, const MergeItem &e2) {
+            return e1.table < e2.table
+                || (e1.table == e2.table && e1.pos < e2.pos);
+    });
+    // add the words in order of first appearance, a new word adds its
+    // subwords at that point just like a single pass over the corpus
+    growable_ = true;
+    for (uint32_t i = 0; i < items.size(); i++) {
+        string_view word = tables[items[i].table]->Word(items[i].pos);
+        AddWord(word, static_cast<float>(items[i].freq), false, true, add_subword);
+    }
+    vector<MergeItem>().swap(items);
+    growable_ = growable;
+
+    uint32_t limit = uint32_t(0.7 * vocab_size);
+    if (Size() <= limit || growable_) {
+        Reindex(max(vocab_size, max_vocab_size_));
+        return;
+    }
+    // keep the entries of the smallest filter frequence that fits
+    vector<int32_t> freqs(Size());
+    for (uint32_t i = 0; i < Size(); i++) {
+        freqs[i] = static_cast<int>(freqs_[i]);
+    }
+    nth_element(freqs.begin(), freqs.begin() + limit, freqs.end(),
+                std::greater<int32_t>());
+    word_filter_freq_ = max(word_filter_freq_ + 1, uint32_t(freqs[limit] + 1));
+    max_vocab_size_ = vocab_size;
+    wordidx_.assign(vocab_size, -1);
+    Rebuild(word_filter_freq_);
+    cerr << "merged table is full (" << vocab_size << "), filter frequence : "
+        << word_filter_freq_ << endl;
+}
+
 void HashTable::FilterPhraseFromNgram(HashTable *word_hash_table,
                                       shared_ptr<ArgsConf> args_conf) {
     vector<string> parts;
-    vector<bool> is_discard(wordvec_.size(), false);
-    uint32_t total_size = wordvec_.size();
-    for (uint32_t i = 0; i < wordvec_.size(); i++) {
+    vector<bool> is_discard(Size(), false);
+    uint32_t total_size = Size();
+    for (uint32_t i = 0; i < Size(); i++) {
         if (i % 100 == 0) {
             cerr << "\rfiltering (" << total_size << ") : "
                 << setw(12) << i << flush;
         }
-        string word = wordvec_[i].word;
-        float freq = wordvec_[i].freq;
+        string word(Word(i));
+        float freq = freqs_[i];
         utils::StringSplit(word, "_", parts);
         if (parts.size() == 0) {
             is_discard[i] = true;
@@ -368,50 +632,109 @@ void HashTable::FilterPhraseFromNgram(HashTable *word_hash_table,
         }
     }
     cerr << endl;
-    vector<Item> temp_vec;
-    temp_vec.insert(temp_vec.end(), wordvec_.begin(), wordvec_.end());
-    wordvec_.clear();
-    for (uint32_t i = 0; i < temp_vec.size(); i++) {
-        if (i % 100 == 0) {
-            cerr << "\rfiltered (" << total_size << ") : "
-                << setw(12) << i << flush;
-        }
+    vector<uint32_t> order;
+    for (uint32_t i = 0; i < total_size; i++) {
         if (is_discard[i] == false) {
-            wordvec_.push_back(temp_vec[i]);
+            order.push_back(i);
         }
     }
-    cerr << endl;
-    wordvec_.shrink_to_fit();
+    Compact(order);
     Rebuild(-1);
 }
 
+void HashTable::Freeze() {
+    vector<string_view> words(Size());
+    for (uint32_t i = 0; i < Size(); i++) {
+        words[i] = Word(i);
+    }
+    perfect_hash_.Build(words);
+    vector<int32_t>().swap(wordidx_);
+    frozen_ = true;
+    cerr << "freeze hash table : " << Size() << " words, perfect hash "
+        << perfect_hash_.MemorySize() / 1048576.0 << " MB" << endl;
+}
+
 void HashTable::Save(shared_ptr<ArgsConf> args_conf) {
+    if (args_conf->modelformat_ == "text") {
+        SaveText(args_conf);
+    } else {
+        SaveBinary(args_conf->outputdir_);
+    }
+}
+
+void HashTable::SaveText(shared_ptr<ArgsConf> args_conf) {
     ofstream ofs;
     utils::OpenOutFile(args_conf->outputdir_, "hashtable.out", ofs);
     utils::WriteLine(ofs, to_string(max_vocab_size_));
     utils::WriteLine(ofs, to_string(wordsize_));
     utils::WriteLine(ofs, to_string(word_filter_freq_));
-    for (uint64_t i = 0; i < wordvec_.size(); i++) {
-        string subwordstr = utils::JoinVector(wordvec_[i].subwords, "|");
-        utils::WriteLine(ofs, wordvec_[i].word
-                    + "\t" + to_string(wordvec_[i].freq)
+    vector<int32_t> subwords;
+    for (uint32_t i = 0; i < Size(); i++) {
+        SubwordSpan span = Subwords(i);
+        subwords.assign(span.begin(), span.end());
+        string subwordstr = utils::JoinVector(subwords, "|");
+        utils::WriteLine(ofs, string(Word(i))
+                    + "\t" + to_string(freqs_[i])
                     + "\t" + subwordstr);
-        // cerr << wordvec_[i].subwords.size() << "\t" << subwordstr << endl;
     }
     utils::CloseOutFile(&ofs);
 }
 
-void HashTable::Load(const string &hash_table_file, float freq_sample) {
+void HashTable::SaveBinary(const string &dir) {
+    string file = dir + "/hashtable.out";
+    ofstream ofs(file, ios::binary);
+    if (!ofs.is_open()) {
+        cerr << "Error : cannot create file " + file << endl;
+        assert(ofs.is_open());
+    }
+    // the sections are the arrays of the table as they are
+    uint64_t size = Size();
+    utils::BinaryHeader header;
+    utils::InitBinaryHeader(utils::BinaryKind::vocab, size, 0, &header);
+    header.extra[0] = max_vocab_size_;
+    header.extra[1] = word_filter_freq_;
+    utils::WriteBinaryHeader(ofs, header);
+
+    // section 1: freqs
+    utils::WriteBinaryVec(ofs, freqs_.data(), size);
+    utils::WriteBinaryPadding(ofs);
+    // section 2: packed words
+    utils::WriteBinaryVec(ofs, word_offsets_.data(), size + 1);
+    utils::WriteBinaryVec(ofs, arena_.data(), arena_.size());
+    utils::WriteBinaryPadding(ofs);
+    // section 3: packed subword ids
+    utils::WriteBinaryVec(ofs, subword_offsets_.data(), size + 1);
+    utils::WriteBinaryVec(ofs, subwords_.data(), subwords_.size());
+    utils::CloseOutFile(&ofs);
+}
+
+void HashTable::Load(const string &hash_table_file,
+                     float freq_sample,
+                     bool freeze) {
+    if (utils::IsBinaryFile(hash_table_file)) {
+        LoadBinary(hash_table_file, freq_sample, freeze);
+    } else {
+        // the text table is indexed word by word, then frozen
+        LoadText(hash_table_file, freq_sample);
+        if (freeze) {
+            Freeze();
+        }
+    }
+}
+
+void HashTable::LoadText(const string &hash_table_file, float freq_sample) {
     ifstream fin(hash_table_file);
     assert(fin.is_open());
 
     string line;
     vector<string> parts;
     vector<string> subword_parts;
+    vector<int32_t> subwords;
     utils::GetLine(fin, line);
     utils::StringTrim(&line);
     assert(utils::StringToNumber(line, &max_vocab_size_));
     assert(max_vocab_size_ > 0);
+    wordidx_.assign(max_vocab_size_, -1);
 
     utils::GetLine(fin, line);
     utils::StringTrim(&line);
@@ -446,7 +769,8 @@ void HashTable::Load(const string &hash_table_file, float freq_sample) {
         int32_t pos = GetWordPos(parts[0]);
         if (pos >= 0 && parts.size() >= 3) {
             utils::StringSplit(parts[2], "|", subword_parts);
-            utils::ParseVec(subword_parts, wordvec_[pos].subwords);
+            utils::ParseVec(subword_parts, subwords);
+            SetSubwords(pos, subwords);
         }
         count++;
     }
@@ -459,4 +783,48 @@ void HashTable::Load(const string &hash_table_file, float freq_sample) {
     utils::CloseInFile(&fin);
     cerr << "finish load hash table " << endl;
 }
+
+void HashTable::LoadBinary(const string &hash_table_file,
+                           float freq_sample,
+                           bool freeze) {
+    ifstream fin(hash_table_file, ios::binary);
+    assert(fin.is_open());
+    utils::BinaryHeader header;
+    utils::ReadBinaryHeader(fin, hash_table_file, utils::BinaryKind::vocab, &header);
+    uint64_t size = header.row;
+    assert(size > 0);
+    max_vocab_size_ = uint32_t(header.extra[0]);
+    word_filter_freq_ = uint32_t(header.extra[1]);
+    assert(max_vocab_size_ >= size);
+    assert(word_filter_freq_ > 0);
+
+    // the sections are read straight into the arrays of the table
+    freqs_.assign(size, 0);
+    word_offsets_.assign(size + 1, 0);
+    subword_offsets_.assign(size + 1, 0);
+    utils::ReadBinaryVec(fin, freqs_.data(), size);
+    utils::SkipBinaryPadding(fin);
+    utils::ReadBinaryVec(fin, word_offsets_.data(), size + 1);
+    arena_.assign(word_offsets_[size], '\0');
+    utils::ReadBinaryVec(fin, &arena_[0], arena_.size());
+    utils::SkipBinaryPadding(fin);
+    utils::ReadBinaryVec(fin, subword_offsets_.data(), size + 1);
+    subwords_.assign(subword_offsets_[size], 0);
+    utils::ReadBinaryVec(fin, subwords_.data(), subwords_.size());
+    utils::CloseInFile(&fin);
+
+    wordsize_ = uint32_t(size);
+    if (freeze) {
+        // the probe array is never built
+        Freeze();
+    } else {
+        wordidx_.assign(max_vocab_size_, -1);
+        for (uint32_t i = 0; i < size; i++) {
+            uint32_t idx = GetWordIdx(Word(i));
+            wordidx_[idx] = int32_t(i);
+        }
+    }
+    InitDiscardTable(freq_sample);
+    cerr << "finish load hash table " << endl;
+}
 } // namespace knowledgeembedding
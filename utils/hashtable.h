@@ -11,23 +11,34 @@
 
 #include "argsconf.h"
 #include "basicutil.h"
+#include "binaryutil.h"
 #include "fileutil.h"
+#include "perfecthash.h"
 #include "textutil.h"
 #include "vectorutil.h"
 
 namespace knowledgeembedding {
-struct Item {
-    string word;
-    vector<int32_t> subwords;
-    float freq;
+// the subword ids of one entry, a view into the subword array
+struct SubwordSpan {
+    const int32_t *first;
+    const int32_t *last;
+    const int32_t *begin() const { return first; }
+    const int32_t *end() const { return last; }
+    uint32_t size() const { return uint32_t(last - first); }
+    bool empty() const { return first == last; }
 };
+
 class HashTable
 {
     public:
-        explicit HashTable(shared_ptr<ArgsConf> args_conf, int vocab_size);
+        // a growable table only counts: it never filters words, its probe
+        // array doubles when it is 0.7 full
+        explicit HashTable(shared_ptr<ArgsConf> args_conf,
+                           int vocab_size,
+                           bool growable = false);
         ~HashTable();
         // get sub word list
-        void GetSubWordList(const string &word,
+        void GetSubWordList(string_view word,
                             vector<int32_t> &subword_list,
                             uint32_t subngram,
                             bool is_build_hash_table = false,
@@ -37,27 +48,31 @@ class HashTable
                             vector<int32_t> &subword_list,
                             uint32_t subngram);
         // get the hash value of word
-        uint32_t GetWordHash(const string &word);
+        uint32_t GetWordHash(string_view word);
         // get word index number of wordIdx
         // return hash index of word or the pos that can insert word
-        uint32_t GetWordIdx(const string &word);
+        uint32_t GetWordIdx(string_view word);
         // filter word that in wordvec, and get the word indexs
-        int32_t GetWordPos(const string &word);
+        int32_t GetWordPos(string_view word);
         void GetWordPos(const vector<string> &words,
                         vector<int32_t> &idx_vec,
                         bool keepout = false);
+        void GetWordPos(const vector<string_view> &words,
+                        vector<int32_t> &idx_vec,
+                        bool keepout = false);
         // get frequence of word
-        float GetWordFreq(const string &word);
+        float GetWordFreq(string_view word);
         // judeg whether the word is in this hash table
-        bool HasWord(const string &word);
+        bool HasWord(string_view word);
         // add a word to this hash table
-        void AddWord(const string &word,
+        void AddWord(string_view word,
                      float default_freq = 1,
                      bool enable_rebuild = true,
                      bool add_freq = true,
                      bool add_subword = false);
         // add all the word of a list to this hash table
         void AddWord(const vector<string> &word_list, bool add_subword = false);
+        void AddWord(const vector<string_view> &word_list, bool add_subword = false);
         // rebuild this hash table, filter low frequence word,
         // and index the high frequent word first
         void Rebuild(int min_word_freq);
@@ -65,29 +80,89 @@ class HashTable
         void InitDiscardTable(float freq_sample);
         // get the number of discard rate
         float GetDiscardRate(uint32_t wordpos, float boost_freq_sample = 1);
-        // random discard some high freq word
+        // random discard some high freq word, rng is the stream of the
+        // calling thread
         void RandomDiscard(vector<int32_t> *word_idx_vec,
+                           utils::Rng *rng,
                            float boost_freq_sample = 1);
         void RandomDiscard(vector<string> *words,
                            vector<int32_t> &word_idx_vec,
+                           utils::Rng *rng,
                            float boost_freq_sample = 1);
+        // set word_idx_vec[i] to -1 for the randomly discarded words,
+        // the other words keep their place
+        void DiscardWordIdx(vector<int32_t> &word_idx_vec,
+                            utils::Rng *rng,
+                            float boost_freq_sample = 1);
         // the infos of index and word
         void PrintHashTable();
-        // combine a wordvec to this hash table
-        void CombineWordVec(const vector<Item> &word_vec);
+        // entries of the table, pos is in [0, Size())
+        uint32_t Size() const { return uint32_t(freqs_.size()); }
+        string_view Word(uint32_t pos) const {
+            return string_view(arena_.data() + word_offsets_[pos],
+                               word_offsets_[pos + 1] - word_offsets_[pos]);
+        }
+        float Freq(uint32_t pos) const { return freqs_[pos]; }
+        SubwordSpan Subwords(uint32_t pos) const {
+            const int32_t *data = subwords_.data();
+            return SubwordSpan{data + subword_offsets_[pos],
+                               data + subword_offsets_[pos + 1]};
+        }
+        // combine the words of another table to this hash table
+        void CombineWordVec(const HashTable &table);
+        // continued training: the words of table that are new here are
+        // appended with their subwords, the other words keep their
+        // positions and add the frequence of table
+        void Append(const HashTable &table);
+        // merge growable tables counted without subwords on consecutive
+        // parts of a corpus into this empty table. words are added in order
+        // of first appearance with their summed frequence, a new word adds
+        // its subwords at that point. the table grows while merging, then
+        // if it is more than 0.7 full the words with frequence below the
+        // smallest filter that fits are removed once, on the counts of the
+        // whole corpus. without that filter the result is the same as one
+        // AddWord pass; a single pass filters on partial counts whenever it
+        // fills up, so a filtered result differs from it
+        void Merge(const vector<shared_ptr<HashTable>> &tables,
+                   int32_t thread_num,
+                   bool add_subword = false);
         // get phrase from ngram
         void FilterPhraseFromNgram(HashTable *word_hash_table,
                                    shared_ptr<ArgsConf> args_conf);
 
+        // the table will not change any more: index the words with a
+        // minimal perfect hash and free the probe array wordidx_.
+        // adding words to a frozen table is an error
+        void Freeze();
+        bool IsFrozen() const { return frozen_; }
+
         // save and load
         void Save(shared_ptr<ArgsConf> args_conf);
-        void Load(const string &hash_table_file, float freq_sample);
+        // binary hashtable.out in dir, whatever modelformat is
+        void SaveBinary(const string &dir);
+        void Load(const string &hash_table_file,
+                  float freq_sample,
+                  bool freeze = false);
 
     public:
-        vector<Item> wordvec_;
         uint32_t wordsize_ = 0;
         uint64_t train_words_ = 0;
 
+    private:
+        // append an entry, or replace the subwords of one
+        void PushWord(string_view word, float freq, const vector<int32_t> &subwords);
+        void SetSubwords(uint32_t pos, const vector<int32_t> &subwords);
+        void Clear();
+        // index all the entries in a probe array of vocab_size
+        void Reindex(uint32_t vocab_size);
+        // keep the entries of order, in that order
+        void Compact(const vector<uint32_t> &order);
+        void SaveText(shared_ptr<ArgsConf> args_conf);
+        void LoadText(const string &hash_table_file, float freq_sample);
+        void LoadBinary(const string &hash_table_file,
+                        float freq_sample,
+                        bool freeze);
+
     private:
         shared_ptr<ArgsConf> args_conf_;
         vector<int32_t> wordidx_;
@@ -95,9 +170,19 @@ class HashTable
         uint32_t max_vocab_size_ = 0;
         uint32_t word_filter_freq_ = 0;
         float hash_freq_sample_ = 0;
+        bool frozen_ = false;
+        bool growable_ = false;
+        utils::PerfectHash perfect_hash_;
 
-        minstd_rand rng_;
-        uniform_real_distribution<> uniform_;
+        // the entries in CSR form: word i is arena_[word_offsets_[i],
+        // word_offsets_[i+1]), its subword ids are subwords_[subword_offsets_[i],
+        // subword_offsets_[i+1]). the arrays are also the sections of the
+        // binary hashtable.out
+        string arena_;
+        vector<uint64_t> word_offsets_;
+        vector<float> freqs_;
+        vector<uint64_t> subword_offsets_;
+        vector<int32_t> subwords_;
 }; // HashTable
 } // namespace knowledgeembedding
 #endif // KNOWLEDGE_EMBEDDING_UTILS_HASHTABLE_H
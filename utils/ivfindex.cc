@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#include "ivfindex.h"
+
+#include <math.h>
+
+#include <functional>
+
+namespace knowledgeembedding {
+namespace utils {
+namespace {
+// kmeans runs on at most kSamplePerList rows of every list
+const uint64_t kSamplePerList = 64;
+const int32_t kKmeansIter = 10;
+
+uint64_t Mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// run fn(begin, end) on thread_num parts of [0, size)
+void ParallelFor(uint64_t size,
+                 int32_t thread_num,
+                 const std::function<void(uint64_t, uint64_t)> &fn) {
+    thread_num = max(1, thread_num);
+    uint64_t step = (size + thread_num - 1) / thread_num;
+    vector<thread> threads;
+    for (uint64_t begin = 0; begin < size; begin += step) {
+        uint64_t end = min(size, begin + step);
+        threads.push_back(thread([=, &fn]() { fn(begin, end); }));
+    }
+    for (auto it = threads.begin(); it != threads.end(); it++) {
+        it->join();
+    }
+}
+
+float InvNorm(const Kernels &kernels, const float *vec, uint32_t col) {
+    float norm = kernels.norm(vec, col);
+    return (fabs(norm) < 1e-6) ? 1 : 1 / norm;
+}
+} // namespace
+
+IvfIndex::IvfIndex() {
+    kernels_ = &GetKernels();
+}
+
+IvfIndex::~IvfIndex() {
+}
+
+uint32_t IvfIndex::NearestList(const float *vec) const {
+    uint32_t best = 0;
+    float best_score = -1e30;
+    for (uint32_t i = 0; i < list_num_; i++) {
+        float score = kernels_->dot(&centroids_[uint64_t(i) * col_], vec, col_);
+        if (score > best_score) {
+            best_score = score;
+            best = i;
+        }
+    }
+    return best;
+}
+
+void IvfIndex::Build(const float *data,
+                     uint64_t row,
+                     uint32_t col,
+                     const vector<uint32_t> &rows,
+                     uint32_t list_num,
+                     int32_t thread_num) {
+    row_ = row;
+    col_ = col;
+    kernels_ = &GetKernels(col);
+    list_num_ = uint32_t(min(uint64_t(max(list_num, 1u)), uint64_t(rows.size())));
+    centroids_.clear();
+    offsets_.assign(list_num_ + 1, 0);
+    ids_.clear();
+    inv_norms_.clear();
+    fingerprint_ = 0;
+    if (list_num_ == 0) {
+        return;
+    }
+
+    // normalized vectors of a random sample of rows
+    minstd_rand rng(1);
+    vector<uint32_t> sample = rows;
+    uint64_t sample_num = min(uint64_t(sample.size()), list_num_ * kSamplePerList);
+    for (uint64_t i = 0; i < sample_num; i++) {
+        uint64_t j = i + rng() % (sample.size() - i);
+        std::swap(sample[i], sample[j]);
+    }
+    sample.resize(sample_num);
+    vector<float> points(sample_num * col_);
+    for (uint64_t i = 0; i < sample_num; i++) {
+        const float *src = data + uint64_t(sample[i]) * col_;
+        float *dest = &points[i * col_];
+        memcpy(dest, src, sizeof(float) * col_);
+        kernels_->scale(dest, InvNorm(*kernels_, dest, col_), col_);
+    }
+
+    // spherical kmeans, the first points are the initial centroids
+    centroids_.assign(points.begin(), points.begin() + uint64_t(list_num_) * col_);
+    vector<uint32_t> assign(sample_num, 0);
+    vector<uint32_t> counts(list_num_, 0);
+    for (int32_t iter = 0; iter < kKmeansIter; iter++) {
+        ParallelFor(sample_num, thread_num, [&](uint64_t begin, uint64_t end) {
+            for (uint64_t i = begin; i < end; i++) {
+                assign[i] = NearestList(&points[i * col_]);
+            }
+        });
+        std::fill(centroids_.begin(), centroids_.end(), 0);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (uint64_t i = 0; i < sample_num; i++) {
+            kernels_->axpy(&centroids_[uint64_t(assign[i]) * col_],
+                           &points[i * col_], 1, col_);
+            counts[assign[i]]++;
+        }
+        for (uint32_t k = 0; k < list_num_; k++) {
+            float *centroid = &centroids_[uint64_t(k) * col_];
+            if (counts[k] == 0) {
+                // restart an empty list from a random point
+                memcpy(centroid, &points[(rng() % sample_num) * col_],
+                       sizeof(float) * col_);
+            }
+            kernels_->scale(centroid, InvNorm(*kernels_, centroid, col_), col_);
+        }
+    }
+
+    // put every row into the list of its nearest centroid
+    vector<uint32_t> row_list(rows.size());
+    vector<float> row_inv_norms(rows.size());
+    ParallelFor(rows.size(), thread_num, [&](uint64_t begin, uint64_t end) {
+        vector<float> vec(col_);
+        for (uint64_t i = begin; i < end; i++) {
+            memcpy(vec.data(), data + uint64_t(rows[i]) * col_, sizeof(float) * col_);
+            row_inv_norms[i] = InvNorm(*kernels_, vec.data(), col_);
+            kernels_->scale(vec.data(), row_inv_norms[i], col_);
+            row_list[i] = NearestList(vec.data());
+        }
+    });
+    for (uint64_t i = 0; i < rows.size(); i++) {
+        offsets_[row_list[i] + 1]++;
+    }
+    for (uint32_t k = 0; k < list_num_; k++) {
+        offsets_[k + 1] += offsets_[k];
+    }
+    ids_.resize(rows.size());
+    inv_norms_.resize(rows.size());
+    vector<uint64_t> pos(offsets_.begin(), offsets_.end() - 1);
+    for (uint64_t i = 0; i < rows.size(); i++) {
+        uint64_t p = pos[row_list[i]]++;
+        ids_[p] = rows[i];
+        inv_norms_[p] = row_inv_norms[i];
+    }
+    fingerprint_ = Fingerprint(data);
+}
+
+void IvfIndex::Search(const float *data,
+                      const float *query,
+                      uint32_t top_size,
+                      uint32_t probe_num,
+                      vector<pair<float, uint32_t>> &result) const {
+    result.clear();
+    if (list_num_ == 0 || top_size == 0) {
+        return;
+    }
+    probe_num = min(max(probe_num, 1u), list_num_);
+    vector<pair<float, uint32_t>> lists(list_num_);
+    for (uint32_t i = 0; i < list_num_; i++) {
+        lists[i].first = kernels_->dot(&centroids_[uint64_t(i) * col_], query, col_);
+        lists[i].second = i;
+    }
+    std::partial_sort(lists.begin(), lists.begin() + probe_num, lists.end(),
+                      std::greater<pair<float, uint32_t>>());
+
+    // min heap of the best top_size rows
+    priority_queue<pair<float, uint32_t>, vector<pair<float, uint32_t>>,
+                   std::greater<pair<float, uint32_t>>> heap;
+    for (uint32_t p = 0; p < probe_num; p++) {
+        uint32_t k = lists[p].second;
+        for (uint64_t i = offsets_[k]; i < offsets_[k + 1]; i++) {
+            float score = kernels_->dot(data + uint64_t(ids_[i]) * col_, query, col_)
+                * inv_norms_[i];
+            if (heap.size() < top_size) {
+                heap.push(make_pair(score, ids_[i]));
+            } else if (score > heap.top().first) {
+                heap.pop();
+                heap.push(make_pair(score, ids_[i]));
+            }
+        }
+    }
+    while (!heap.empty()) {
+        result.push_back(heap.top());
+        heap.pop();
+    }
+    std::reverse(result.begin(), result.end());
+}
+
+void IvfIndex::Save(const string &file_path) const {
+    ofstream ofs(file_path, ios::binary);
+    if (!ofs.is_open()) {
+        cerr << "Error : can not write ann index " << file_path << endl;
+        return;
+    }
+    BinaryHeader header;
+    InitBinaryHeader(BinaryKind::ann, list_num_, col_, &header);
+    header.extra[0] = row_;
+    header.extra[1] = ids_.size();
+    header.extra[2] = fingerprint_;
+    WriteBinaryHeader(ofs, header);
+    WriteBinaryVec(ofs, centroids_.data(), centroids_.size());
+    WriteBinaryVec(ofs, offsets_.data(), offsets_.size());
+    WriteBinaryVec(ofs, ids_.data(), ids_.size());
+    WriteBinaryVec(ofs, inv_norms_.data(), inv_norms_.size());
+    CloseOutFile(&ofs);
+}
+
+bool IvfIndex::Load(const string &file_path,
+                    const float *data,
+                    uint64_t row,
+                    uint32_t col) {
+    ifstream ifs(file_path, ios::binary);
+    if (!ifs.is_open()) {
+        return false;
+    }
+    BinaryHeader header;
+    ReadBinaryHeader(ifs, file_path, BinaryKind::ann, &header);
+    if (header.col != col || header.extra[0] != row) {
+        cerr << "ann index " << file_path << " does not match the model" << endl;
+        return false;
+    }
+    row_ = row;
+    col_ = col;
+    kernels_ = &GetKernels(col);
+    list_num_ = uint32_t(header.row);
+    uint64_t size = header.extra[1];
+    centroids_.resize(uint64_t(list_num_) * col_);
+    offsets_.resize(list_num_ + 1);
+    ids_.resize(size);
+    inv_norms_.resize(size);
+    ReadBinaryVec(ifs, centroids_.data(), centroids_.size());
+    ReadBinaryVec(ifs, offsets_.data(), offsets_.size());
+    ReadBinaryVec(ifs, ids_.data(), ids_.size());
+    ReadBinaryVec(ifs, inv_norms_.data(), inv_norms_.size());
+    // the same shape does not mean the same rows, e.g. a model dir
+    // trained again or a checkpoint written over it
+    fingerprint_ = Fingerprint(data);
+    if (fingerprint_ != header.extra[2]) {
+        cerr << "ann index " << file_path << " is stale, the rows changed" << endl;
+        return false;
+    }
+    return true;
+}
+
+uint64_t IvfIndex::Fingerprint(const float *data) const {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < ids_.size(); i++) {
+        const uint32_t *bits = reinterpret_cast<const uint32_t *>(
+            data + uint64_t(ids_[i]) * col_);
+        // fnv-1a over the float bits, the mixed row hashes are added so
+        // the order of the lists does not matter
+        uint64_t h = 14695981039346656037ULL ^ ids_[i];
+        for (uint32_t j = 0; j < col_; j++) {
+            h = (h ^ bits[j]) * 1099511628211ULL;
+        }
+        sum += Mix(h);
+    }
+    return sum;
+}
+} // namespace utils
+} // namespace knowledgeembedding
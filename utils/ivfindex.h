@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#ifndef KNOWLEDGE_EMBEDDING_UTILS_IVFINDEX_H
+#define KNOWLEDGE_EMBEDDING_UTILS_IVFINDEX_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "basicutil.h"
+#include "binaryutil.h"
+#include "simdutil.h"
+
+namespace knowledgeembedding {
+namespace utils {
+    // inverted file index for cosine nearest neighbors over some rows of a
+    // row-major matrix. the rows are clustered by spherical kmeans into
+    // lists, a query only scans the lists of its probe_num most similar
+    // centroids: more probes give higher recall and slower queries.
+    // the index keeps row ids and norms only, the vectors stay in the matrix
+    class IvfIndex {
+        public:
+            IvfIndex();
+            ~IvfIndex();
+            // cluster rows of the row x col matrix data into list_num lists
+            void Build(const float *data,
+                       uint64_t row,
+                       uint32_t col,
+                       const vector<uint32_t> &rows,
+                       uint32_t list_num,
+                       int32_t thread_num);
+            // the top_size rows most similar to the normalized query,
+            // best first, data must be the matrix of Build
+            void Search(const float *data,
+                        const float *query,
+                        uint32_t top_size,
+                        uint32_t probe_num,
+                        vector<pair<float, uint32_t>> &result) const;
+            void Save(const string &file_path) const;
+            // return false if there is no index file or it was built on a
+            // matrix of another shape, or on other values of its rows
+            bool Load(const string &file_path,
+                      const float *data,
+                      uint64_t row,
+                      uint32_t col);
+            uint64_t Size() const { return ids_.size(); }
+            uint32_t ListNum() const { return list_num_; }
+
+        private:
+            // the list of the centroid most similar to vec
+            uint32_t NearestList(const float *vec) const;
+            // hash of the values of the rows in ids_, in any order
+            uint64_t Fingerprint(const float *data) const;
+
+        private:
+            uint64_t row_ = 0;
+            uint32_t col_ = 0;
+            uint32_t list_num_ = 0;
+            // list_num_ x col_ normalized centroids
+            vector<float> centroids_;
+            // ids_[offsets_[i], offsets_[i+1]) are the rows of list i
+            vector<uint64_t> offsets_;
+            vector<uint32_t> ids_;
+            // 1 / norm of every row of ids_
+            vector<float> inv_norms_;
+            uint64_t fingerprint_ = 0;
+            const Kernels *kernels_;
+    };
+} // namespace utils
+} // namespace knowledgeembedding
+#endif // KNOWLEDGE_EMBEDDING_UTILS_IVFINDEX_H
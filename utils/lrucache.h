@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#ifndef KNOWLEDGE_EMBEDDING_UTILS_LRUCACHE_H
+#define KNOWLEDGE_EMBEDDING_UTILS_LRUCACHE_H
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "basicutil.h"
+
+namespace knowledgeembedding {
+namespace utils {
+    // bounded string -> V map for many threads, a full cache drops its
+    // least recently used entry. the keys are spread over shards with a
+    // lock each, so threads rarely wait for each other
+    template<typename V>
+    class LruCache {
+        public:
+            explicit LruCache(uint64_t capacity, uint32_t shard_num = 16)
+                : shards_(max(shard_num, 1u)) {
+                uint64_t shard_capacity = capacity / shards_.size();
+                for (uint32_t i = 0; i < shards_.size(); i++) {
+                    shards_[i].capacity = max(shard_capacity, uint64_t(1));
+                }
+            }
+            // copy the value of key, false if key is not cached
+            bool Get(string_view key, V *value) {
+                Shard &shard = GetShard(key);
+                std::lock_guard<std::mutex> lock(shard.lock);
+                auto it = shard.index.find(key);
+                if (it == shard.index.end()) {
+                    shard.misses++;
+                    return false;
+                }
+                shard.hits++;
+                // move the entry to the front
+                shard.items.splice(shard.items.begin(), shard.items, it->second);
+                *value = it->second->second;
+                return true;
+            }
+            void Put(string_view key, const V &value) {
+                Shard &shard = GetShard(key);
+                std::lock_guard<std::mutex> lock(shard.lock);
+                auto it = shard.index.find(key);
+                if (it != shard.index.end()) {
+                    it->second->second = value;
+                    shard.items.splice(shard.items.begin(), shard.items, it->second);
+                    return;
+                }
+                if (shard.items.size() >= shard.capacity) {
+                    shard.index.erase(string_view(shard.items.back().first));
+                    shard.items.pop_back();
+                }
+                shard.items.emplace_front(string(key), value);
+                // the key view points into the list node, which never moves
+                shard.index[string_view(shard.items.front().first)] = shard.items.begin();
+            }
+            uint64_t Hits() const { return Sum(&Shard::hits); }
+            uint64_t Misses() const { return Sum(&Shard::misses); }
+            uint64_t Size() const {
+                uint64_t size = 0;
+                for (uint32_t i = 0; i < shards_.size(); i++) {
+                    std::lock_guard<std::mutex> lock(shards_[i].lock);
+                    size += shards_[i].items.size();
+                }
+                return size;
+            }
+
+        private:
+            typedef std::list<pair<string, V>> ItemList;
+            struct Shard {
+                mutable std::mutex lock;
+                ItemList items;
+                std::unordered_map<string_view, typename ItemList::iterator> index;
+                uint64_t capacity = 1;
+                uint64_t hits = 0;
+                uint64_t misses = 0;
+            };
+
+            Shard &GetShard(string_view key) {
+                return shards_[std::hash<string_view>()(key) % shards_.size()];
+            }
+            uint64_t Sum(uint64_t Shard::*counter) const {
+                uint64_t sum = 0;
+                for (uint32_t i = 0; i < shards_.size(); i++) {
+                    std::lock_guard<std::mutex> lock(shards_[i].lock);
+                    sum += shards_[i].*counter;
+                }
+                return sum;
+            }
+
+        private:
+            vector<Shard> shards_;
+    };
+} // namespace utils
+} // namespace knowledgeembedding
+#endif // KNOWLEDGE_EMBEDDING_UTILS_LRUCACHE_H
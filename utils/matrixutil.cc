@@ -25,11 +25,10 @@ void MatrixMul(float *data,
                uint32_t col) {
     assert(hidden_vec.size() == col);
     assert(result_vec.size() == row);
+    const Kernels &kernels = GetKernels();
     for (uint32_t i = 0; i < row; i++) {
-        for (uint32_t j = 0; j < col; j++) {
-            uint64_t idx = uint64_t(i) * uint64_t(col) + uint64_t(j);
-            result_vec[i] += data[idx] * hidden_vec[j] * mask_vec[j];
-        }
+        result_vec[i] += kernels.dot_mask(RowPtr(data, i, col), hidden_vec.data(),
+                                          mask_vec.data(), col);
     }
 }
 
@@ -39,25 +38,14 @@ float MatrixDowRow(float *data1,
                    float *data2,
                    uint32_t idx2,
                    uint32_t col) {
-    float res = 0;
-    for (uint32_t i = 0; i < col; i++) {
-        uint64_t i1 = uint64_t(idx1) * uint64_t(col) + uint64_t(i);
-        uint64_t i2 = uint64_t(idx2) * uint64_t(col) + uint64_t(i);
-        res += data1[i1] * data2[i2];
-    }
-    return res;
+    return GetKernels().dot(RowPtr(data1, idx1, col), RowPtr(data2, idx2, col), col);
 }
 float MatrixDowRow(float *data1,
                    uint32_t idx1,
                    const vector<float> &vec,
                    uint32_t col) {
     assert(col == vec.size());
-    float res = 0;
-    for (uint32_t i = 0; i < col; i++) {
-        uint64_t i1 = uint64_t(idx1) * uint64_t(col) + uint64_t(i);
-        res += data1[i1] * vec[i];
-    }
-    return res;
+    return GetKernels().dot(RowPtr(data1, idx1, col), vec.data(), col);
 }
 float MatrixDowRow(float *data1,
                    uint32_t idx1,
@@ -66,12 +54,8 @@ float MatrixDowRow(float *data1,
                    const vector<float> &mask_vec) {
     assert(col == vec.size());
     assert(col == mask_vec.size());
-    float res = 0;
-    for (uint32_t i = 0; i < col; i++) {
-        uint64_t i1 = uint64_t(idx1) * uint64_t(col) + uint64_t(i);
-        res += data1[i1] * vec[i] * mask_vec[i];
-    }
-    return res;
+    return GetKernels().dot_mask(RowPtr(data1, idx1, col), vec.data(),
+                                 mask_vec.data(), col);
 }
 // maxtirx update function
 void MatrixAdd(float *dest_data,
@@ -80,11 +64,8 @@ void MatrixAdd(float *dest_data,
                uint32_t src_idx,
                uint32_t col,
                float rate) {
-    for (uint32_t i = 0; i < col; i++) {
-        uint64_t idest = uint64_t(dest_idx) * uint64_t(col) + uint64_t(i);
-        uint64_t isrc = uint64_t(src_idx) * uint64_t(col) + uint64_t(i);
-        dest_data[idest] += rate * src_data[isrc];
-    }
+    GetKernels().axpy(RowPtr(dest_data, dest_idx, col),
+                      RowPtr(src_data, src_idx, col), rate, col);
 }
 void MatrixAdd(float *dest_data,
                uint32_t dest_idx,
@@ -92,10 +73,7 @@ void MatrixAdd(float *dest_data,
                uint32_t col,
                float rate) {
     assert(col == vec.size());
-    for (uint32_t i = 0; i < col; i++) {
-        uint64_t idest = uint64_t(dest_idx) * uint64_t(col) + uint64_t(i);
-        dest_data[idest] += rate * vec[i];
-    }
+    GetKernels().axpy(RowPtr(dest_data, dest_idx, col), vec.data(), rate, col);
 }
 void MatrixAdd(float *dest_data,
                uint32_t dest_idx,
@@ -104,10 +82,8 @@ void MatrixAdd(float *dest_data,
                float rate,
                const vector<float> &mask_vec) {
     assert(col == vec.size());
-    for (uint32_t i = 0; i < col; i++) {
-        uint64_t idest = uint64_t(dest_idx) * uint64_t(col) + uint64_t(i);
-        dest_data[idest] += rate * vec[i] * mask_vec[i];
-    }
+    GetKernels().axpy_mask(RowPtr(dest_data, dest_idx, col), vec.data(),
+                           mask_vec.data(), rate, col);
 }
 
 
@@ -118,10 +94,7 @@ void MatrixGetVec(vector<float> *vec,
                   uint32_t col,
                   float rate) {
     assert(col == vec->size());
-    for (uint32_t i = 0; i < col; i++) {
-        uint64_t isrc = uint64_t(src_idx) * uint64_t(col) + uint64_t(i);
-        (*vec)[i] += rate * src_data[isrc];
-    }
+    GetKernels().axpy(vec->data(), RowPtr(src_data, src_idx, col), rate, col);
 }
 void MatrixGetVec(vector<float> *vec,
                   float *src_data,
@@ -131,20 +104,13 @@ void MatrixGetVec(vector<float> *vec,
                   const vector<float> &mask_vec) {
     assert(col == vec->size());
     assert(col == mask_vec.size());
-    for (uint32_t i = 0; i < col; i++) {
-        uint64_t isrc = uint64_t(src_idx) * uint64_t(col) + uint64_t(i);
-        (*vec)[i] += rate * src_data[isrc] * mask_vec[i];
-    }
+    GetKernels().axpy_mask(vec->data(), RowPtr(src_data, src_idx, col),
+                           mask_vec.data(), rate, col);
 }
 float MatrixNorm(float *dest_data,
                  uint32_t dest_idx,
                  uint32_t col) {
-    float res = 0;
-    for (uint32_t i = 0; i < col; i++) {
-        uint64_t idest = uint64_t(dest_idx) * uint64_t(col) + uint64_t(i);
-        res += dest_data[idest] * dest_data[idest];
-    }
-    return sqrt(res);
+    return GetKernels().norm(RowPtr(dest_data, dest_idx, col), col);
 }
 } // namespace utils
 } // namespace knowledgeembedding
@@ -7,11 +7,19 @@
 #include <string>
 #include <vector>
 #include "basicutil.h"
+#include "simdutil.h"
 
 namespace knowledgeembedding {
 namespace utils {
     // print matrix at index: i
     void Print(uint32_t i);
+    // start of row i in a row-major matrix
+    inline float* RowPtr(float *data, uint32_t i, uint32_t col) {
+        return data + uint64_t(i) * uint64_t(col);
+    }
+    inline const float* RowPtr(const float *data, uint32_t i, uint32_t col) {
+        return data + uint64_t(i) * uint64_t(col);
+    }
     // get matrix mul vec
     void MatrixMul(float *data,
                    const vector<float> &hidden_vec,
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#include "numautil.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "fileutil.h"
+
+// mbind without linking libnuma
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1 << 1)
+#endif
+
+namespace knowledgeembedding {
+namespace utils {
+namespace {
+const int32_t kMaxNode = 1024;
+const int32_t kMaskBits = 8 * sizeof(unsigned long);
+
+// parse a kernel cpu list like "0-3,8-11"
+vector<int32_t> ParseCpuList(const string &text) {
+    vector<int32_t> cpus;
+    vector<string> parts;
+    StringSplit(StringTrim(text), ",", parts);
+    for (uint32_t i = 0; i < parts.size(); i++) {
+        size_t dash = parts[i].find('-');
+        int32_t first = 0;
+        int32_t last = 0;
+        if (!StringToNumber(parts[i].substr(0, dash), &first)) {
+            continue;
+        }
+        last = first;
+        if (dash != string::npos
+            && !StringToNumber(parts[i].substr(dash + 1), &last)) {
+            continue;
+        }
+        for (int32_t cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// the kernel ids of the nodes of GetNumaNodes
+vector<int32_t> &NodeIds() {
+    static vector<int32_t> ids;
+    return ids;
+}
+
+vector<vector<int32_t>> LoadNumaNodes() {
+    vector<vector<int32_t>> nodes;
+    for (int32_t node = 0; node < kMaxNode; node++) {
+        ifstream fin("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+        if (!fin.is_open()) {
+            // node numbers may have holes, stop after a long gap
+            if (node > int32_t(nodes.size()) + 64) {
+                break;
+            }
+            continue;
+        }
+        string line;
+        GetLine(fin, line);
+        vector<int32_t> cpus = ParseCpuList(line);
+        // memory only nodes have no cpus to run train threads
+        if (!cpus.empty()) {
+            nodes.push_back(cpus);
+            NodeIds().push_back(node);
+        }
+    }
+    if (nodes.empty()) {
+        vector<int32_t> cpus;
+        int32_t cpu_num = max(1, static_cast<int32_t>(thread::hardware_concurrency()));
+        for (int32_t cpu = 0; cpu < cpu_num; cpu++) {
+            cpus.push_back(cpu);
+        }
+        nodes.push_back(cpus);
+        NodeIds().push_back(0);
+    }
+    return nodes;
+}
+
+// mbind the whole pages of [data, data + size), MPOL_MF_MOVE also moves
+// the pages that are already there
+bool BindPages(void *data, uint64_t size, int mode,
+               const vector<unsigned long> &mask) {
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    uint64_t begin = (reinterpret_cast<uint64_t>(data) + page - 1) / page * page;
+    uint64_t end = (reinterpret_cast<uint64_t>(data) + size) / page * page;
+    if (end <= begin) {
+        return true;
+    }
+    // the kernel reads maxnode - 1 bits
+    return syscall(SYS_mbind, begin, end - begin, mode, mask.data(),
+                   mask.size() * kMaskBits + 1, MPOL_MF_MOVE) == 0;
+}
+} // namespace
+
+const vector<vector<int32_t>> &GetNumaNodes() {
+    static const vector<vector<int32_t>> nodes = LoadNumaNodes();
+    return nodes;
+}
+
+int32_t ThreadNode(int32_t thread_id) {
+    return thread_id % int32_t(GetNumaNodes().size());
+}
+
+vector<int32_t> ThreadCpus(int32_t thread_id, const string &affinity) {
+    const vector<int32_t> &cpus = GetNumaNodes()[ThreadNode(thread_id)];
+    if (affinity == "core") {
+        // the threads of one node take its cpus in turn
+        int32_t index = thread_id / int32_t(GetNumaNodes().size());
+        return vector<int32_t>(1, cpus[index % cpus.size()]);
+    }
+    return cpus;
+}
+
+bool PinThread(const vector<int32_t> &cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (uint32_t i = 0; i < cpus.size(); i++) {
+        if (cpus[i] < CPU_SETSIZE) {
+            CPU_SET(cpus[i], &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool LowerThreadPriority() {
+    // linux applies the nice value of a thread id to that thread only
+    return setpriority(PRIO_PROCESS, pid_t(syscall(SYS_gettid)), 19) == 0;
+}
+
+string CpuListStr(const vector<int32_t> &cpus) {
+    string res = "";
+    for (uint32_t i = 0; i < cpus.size(); i++) {
+        uint32_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+            j++;
+        }
+        res += (res.empty() ? "" : ",") + to_string(cpus[i]);
+        if (j > i) {
+            res += "-" + to_string(cpus[j]);
+        }
+        i = j;
+    }
+    return res;
+}
+
+string PlaceMatrix(float *data,
+                   uint64_t row,
+                   uint32_t col,
+                   const string &policy,
+                   int32_t thread_num) {
+    int32_t node_num = int32_t(GetNumaNodes().size());
+    if (policy == "none") {
+        return "first touch of the init thread";
+    }
+    if (node_num <= 1) {
+        return "single numa node, " + policy + " has no effect";
+    }
+    uint64_t size = row * col * sizeof(float);
+    if (policy == "interleave") {
+        const vector<int32_t> &ids = NodeIds();
+        int32_t max_id = *std::max_element(ids.begin(), ids.end());
+        vector<unsigned long> mask(max_id / kMaskBits + 1, 0);
+        for (uint32_t i = 0; i < ids.size(); i++) {
+            mask[ids[i] / kMaskBits] |= 1UL << (ids[i] % kMaskBits);
+        }
+        if (!BindPages(data, size, MPOL_INTERLEAVE, mask)) {
+            return "interleave failed (mbind), first touch of the init thread";
+        }
+        return "interleaved over " + to_string(node_num) + " nodes";
+    }
+    // firsttouch: block i is zeroed on the node of train thread i
+    thread_num = max(1, thread_num);
+    uint64_t step = (row + thread_num - 1) / thread_num;
+    vector<thread> threads;
+    for (int32_t i = 0; i < thread_num; i++) {
+        uint64_t begin = min(row, step * i);
+        uint64_t end = min(row, begin + step);
+        threads.push_back(thread([=]() {
+            PinThread(GetNumaNodes()[ThreadNode(i)]);
+            memset(data + begin * col, 0, (end - begin) * col * sizeof(float));
+        }));
+    }
+    for (auto it = threads.begin(); it != threads.end(); it++) {
+        it->join();
+    }
+    return "first touch of " + to_string(thread_num) + " row blocks over "
+        + to_string(node_num) + " nodes";
+}
+} // namespace utils
+} // namespace knowledgeembedding
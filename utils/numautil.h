@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#ifndef KNOWLEDGE_EMBEDDING_UTILS_NUMAUTIL_H
+#define KNOWLEDGE_EMBEDDING_UTILS_NUMAUTIL_H
+
+#include <string>
+#include <vector>
+
+#include "basicutil.h"
+
+namespace knowledgeembedding {
+namespace utils {
+    // cpus of every online numa node, one node with all cpus if the
+    // kernel has no numa info
+    const vector<vector<int32_t>> &GetNumaNodes();
+    // train thread thread_id runs on node thread_id % node number,
+    // affinity "node" allows all cpus of the node, "core" one of them
+    int32_t ThreadNode(int32_t thread_id);
+    vector<int32_t> ThreadCpus(int32_t thread_id, const string &affinity);
+    // pin the calling thread, return false if the kernel refuses
+    bool PinThread(const vector<int32_t> &cpus);
+    // nice 19 for the calling thread only, helper threads like
+    // the async eval yield the cpu to the train threads
+    bool LowerThreadPriority();
+    // "0-3,8" style list
+    string CpuListStr(const vector<int32_t> &cpus);
+    // place the pages of a row x col matrix before they are written:
+    // "interleave" spreads the pages over all nodes, "firsttouch" splits
+    // the rows into thread_num blocks and zeroes block i from a thread on
+    // the node of train thread i. return the placement for the report
+    string PlaceMatrix(float *data,
+                       uint64_t row,
+                       uint32_t col,
+                       const string &policy,
+                       int32_t thread_num);
+} // namespace utils
+} // namespace knowledgeembedding
+#endif // KNOWLEDGE_EMBEDDING_UTILS_NUMAUTIL_H
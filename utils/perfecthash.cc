@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#include "perfecthash.h"
+
+namespace knowledgeembedding {
+namespace utils {
+namespace {
+// average keys of a bucket, bigger buckets need fewer seeds but take
+// longer to place
+const uint32_t kBucketSize = 4;
+const uint32_t kMaxSeed = 1u << 30;
+const int32_t kMaxSalt = 16;
+
+// x * n / 2^32 is in [0, n) like x % n, without the division
+uint32_t Range(uint32_t x, uint32_t n) {
+    return uint32_t((uint64_t(x) * n) >> 32);
+}
+
+uint64_t Mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+} // namespace
+
+PerfectHash::PerfectHash() {
+}
+
+PerfectHash::~PerfectHash() {
+}
+
+uint64_t PerfectHash::Hash(string_view key) const {
+    // fnv-1a 64, mixed so that every bit depends on the whole key
+    uint64_t h = 14695981039346656037ULL ^ salt_;
+    for (uint32_t i = 0; i < key.size(); i++) {
+        h = (h ^ uint8_t(key[i])) * 1099511628211ULL;
+    }
+    return Mix(h);
+}
+
+uint32_t PerfectHash::Slot(uint64_t hash, uint32_t seed) const {
+    return Range(uint32_t(Mix(hash + seed * 0x9E3779B97F4A7C15ULL)),
+                 uint32_t(slots_.size()));
+}
+
+uint64_t PerfectHash::MemorySize() const {
+    return slots_.size() * sizeof(uint64_t) + seeds_.size() * sizeof(uint32_t);
+}
+
+bool PerfectHash::TryBuild(const vector<string_view> &keys) {
+    uint32_t size = uint32_t(keys.size());
+    uint32_t bucket_num = size / kBucketSize + 1;
+    vector<uint64_t> hashes(size);
+    vector<uint32_t> offsets(bucket_num + 1, 0);
+    for (uint32_t i = 0; i < size; i++) {
+        hashes[i] = Hash(keys[i]);
+        offsets[Range(uint32_t(hashes[i]), bucket_num) + 1]++;
+    }
+    for (uint32_t b = 0; b < bucket_num; b++) {
+        offsets[b + 1] += offsets[b];
+    }
+    // keys of bucket b are members[offsets[b], offsets[b+1])
+    vector<uint32_t> members(size);
+    vector<uint32_t> pos(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0; i < size; i++) {
+        members[pos[Range(uint32_t(hashes[i]), bucket_num)]++] = i;
+    }
+    // the big buckets first, while the table is still empty
+    vector<uint32_t> order(bucket_num);
+    for (uint32_t b = 0; b < bucket_num; b++) {
+        order[b] = b;
+    }
+    stable_sort(order.begin(), order.end(), [&](uint32_t b1, uint32_t b2) {
+        return offsets[b1 + 1] - offsets[b1] > offsets[b2 + 1] - offsets[b2];
+    });
+
+    slots_.assign(size, 0);
+    seeds_.assign(bucket_num, 0);
+    vector<bool> taken(size, false);
+    vector<uint32_t> bucket_slots;
+    for (auto b : order) {
+        uint32_t begin = offsets[b];
+        uint32_t end = offsets[b + 1];
+        if (begin == end) {
+            break;
+        }
+        for (uint32_t i = begin; i < end; i++) {
+            for (uint32_t j = begin; j < i; j++) {
+                if (hashes[members[i]] == hashes[members[j]]) {
+                    return false;
+                }
+            }
+        }
+        uint32_t seed = 0;
+        for (; seed < kMaxSeed; seed++) {
+            bucket_slots.clear();
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t slot = Slot(hashes[members[i]], seed);
+                if (taken[slot] || find(bucket_slots.begin(), bucket_slots.end(), slot)
+                        != bucket_slots.end()) {
+                    break;
+                }
+                bucket_slots.push_back(slot);
+            }
+            if (bucket_slots.size() == end - begin) {
+                break;
+            }
+        }
+        if (seed == kMaxSeed) {
+            return false;
+        }
+        seeds_[b] = seed;
+        for (uint32_t i = begin; i < end; i++) {
+            uint32_t slot = bucket_slots[i - begin];
+            taken[slot] = true;
+            slots_[slot] = (hashes[members[i]] >> 32 << 32) | members[i];
+        }
+    }
+    return true;
+}
+
+void PerfectHash::Build(const vector<string_view> &keys) {
+    for (int32_t salt = 0; salt < kMaxSalt; salt++) {
+        salt_ = Mix(salt + 1);
+        if (TryBuild(keys)) {
+            return;
+        }
+    }
+    cerr << "Error : can not build the perfect hash of "
+        << keys.size() << " keys, are they distinct?" << endl;
+    exit(1);
+}
+
+int32_t PerfectHash::Find(string_view key) const {
+    if (slots_.empty()) {
+        return -1;
+    }
+    uint64_t hash = Hash(key);
+    uint32_t seed = seeds_[Range(uint32_t(hash), uint32_t(seeds_.size()))];
+    uint64_t entry = slots_[Slot(hash, seed)];
+    if ((entry >> 32) != (hash >> 32)) {
+        return -1;
+    }
+    return int32_t(uint32_t(entry));
+}
+} // namespace utils
+} // namespace knowledgeembedding
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#ifndef KNOWLEDGE_EMBEDDING_UTILS_PERFECTHASH_H
+#define KNOWLEDGE_EMBEDDING_UTILS_PERFECTHASH_H
+
+#include <string>
+#include <vector>
+
+#include "basicutil.h"
+
+namespace knowledgeembedding {
+namespace utils {
+    // minimal perfect hash over a fixed set of distinct keys (hash and
+    // displace): a key hashes to a bucket, every bucket keeps the seed that
+    // sends its keys to free slots of a table with one slot per key.
+    // a slot keeps the key index and a 32 bit fingerprint of the key, so
+    // most keys outside the set are rejected without reading any string
+    class PerfectHash {
+        public:
+            PerfectHash();
+            ~PerfectHash();
+            // index keys[i] as i
+            void Build(const vector<string_view> &keys);
+            // the only index key can have, -1 if the fingerprint rules it
+            // out. the caller compares the key of that index to be sure
+            int32_t Find(string_view key) const;
+            uint32_t Size() const { return uint32_t(slots_.size()); }
+            // bytes of the bucket seeds and slots
+            uint64_t MemorySize() const;
+
+        private:
+            uint64_t Hash(string_view key) const;
+            uint32_t Slot(uint64_t hash, uint32_t seed) const;
+            // false if some keys of one bucket can not be split, the build
+            // is then retried with another salt
+            bool TryBuild(const vector<string_view> &keys);
+
+        private:
+            uint64_t salt_ = 0;
+            // slot -> fingerprint << 32 | key index
+            vector<uint64_t> slots_;
+            vector<uint32_t> seeds_;
+    };
+} // namespace utils
+} // namespace knowledgeembedding
+#endif // KNOWLEDGE_EMBEDDING_UTILS_PERFECTHASH_H
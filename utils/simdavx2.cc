@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#include "simdkernel.h"
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+
+namespace knowledgeembedding {
+namespace utils {
+namespace {
+inline float HorizontalSum(__m256 v) {
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+    __m128 shuf = _mm_movehdup_ps(lo);
+    __m128 sums = _mm_add_ps(lo, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+template<uint32_t N>
+float Dot(const float *x, const float *y, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 8),
+                               _mm256_loadu_ps(y + i + 8), acc1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), acc0);
+    }
+    float res = HorizontalSum(_mm256_add_ps(acc0, acc1));
+    for (; i < n; i++) {
+        res += x[i] * y[i];
+    }
+    return res;
+}
+
+template<uint32_t N>
+void DotRows(float *out, const float *x, const float *y, uint32_t m, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    uint32_t i = 0;
+    // 4 rows share every load of y
+    for (; i + 4 <= m; i += 4) {
+        const float *x0 = x + uint64_t(i) * n;
+        const float *x1 = x0 + n;
+        const float *x2 = x1 + n;
+        const float *x3 = x2 + n;
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+        uint32_t j = 0;
+        for (; j + 8 <= n; j += 8) {
+            __m256 vy = _mm256_loadu_ps(y + j);
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x0 + j), vy, acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(x1 + j), vy, acc1);
+            acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(x2 + j), vy, acc2);
+            acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(x3 + j), vy, acc3);
+        }
+        out[i] = HorizontalSum(acc0);
+        out[i + 1] = HorizontalSum(acc1);
+        out[i + 2] = HorizontalSum(acc2);
+        out[i + 3] = HorizontalSum(acc3);
+        for (; j < n; j++) {
+            out[i] += x0[j] * y[j];
+            out[i + 1] += x1[j] * y[j];
+            out[i + 2] += x2[j] * y[j];
+            out[i + 3] += x3[j] * y[j];
+        }
+    }
+    for (; i < m; i++) {
+        out[i] = Dot<N>(x + uint64_t(i) * n, y, n);
+    }
+}
+
+template<uint32_t N>
+float DotMask(const float *x, const float *y, const float *mask, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m256 acc = _mm256_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 xy = _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i));
+        acc = _mm256_fmadd_ps(xy, _mm256_loadu_ps(mask + i), acc);
+    }
+    float res = HorizontalSum(acc);
+    for (; i < n; i++) {
+        res += x[i] * y[i] * mask[i];
+    }
+    return res;
+}
+
+template<uint32_t N>
+void Axpy(float *y, const float *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m256 va = _mm256_set1_ps(a);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 vy = _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i));
+        _mm256_storeu_ps(y + i, vy);
+    }
+    for (; i < n; i++) {
+        y[i] += a * x[i];
+    }
+}
+
+template<uint32_t N>
+void AxpyInt8(float *y, const int8_t *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m256 va = _mm256_set1_ps(a);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i xi = _mm256_cvtepi8_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i *>(x + i)));
+        __m256 vy = _mm256_fmadd_ps(va, _mm256_cvtepi32_ps(xi), _mm256_loadu_ps(y + i));
+        _mm256_storeu_ps(y + i, vy);
+    }
+    for (; i < n; i++) {
+        y[i] += a * x[i];
+    }
+}
+
+template<uint32_t N>
+void AxpyMask(float *y, const float *x, const float *mask, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m256 va = _mm256_set1_ps(a);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 ax = _mm256_mul_ps(va, _mm256_loadu_ps(x + i));
+        __m256 vy = _mm256_fmadd_ps(ax, _mm256_loadu_ps(mask + i), _mm256_loadu_ps(y + i));
+        _mm256_storeu_ps(y + i, vy);
+    }
+    for (; i < n; i++) {
+        y[i] += a * x[i] * mask[i];
+    }
+}
+
+template<uint32_t N>
+void AxpyGrad(float *g, float *y, const float *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m256 va = _mm256_set1_ps(a);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 vy = _mm256_loadu_ps(y + i);
+        _mm256_storeu_ps(g + i, _mm256_fmadd_ps(va, vy, _mm256_loadu_ps(g + i)));
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), vy));
+    }
+    for (; i < n; i++) {
+        g[i] += a * y[i];
+        y[i] += a * x[i];
+    }
+}
+
+// exp(x) of x in [-87, 0]: 2^k * p(r) with x = k * ln2 + r, p is the
+// cephes polynomial of expf
+inline __m256 Exp(__m256 x) {
+    x = _mm256_max_ps(x, _mm256_set1_ps(-87.0f));
+    __m256i k = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)));
+    __m256 fk = _mm256_cvtepi32_ps(k);
+    __m256 r = _mm256_fnmadd_ps(fk, _mm256_set1_ps(0.693359375f), x);
+    r = _mm256_fnmadd_ps(fk, _mm256_set1_ps(-2.12194440e-4f), r);
+    __m256 p = _mm256_set1_ps(1.9875691500e-4f);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+    p = _mm256_fmadd_ps(_mm256_mul_ps(p, r), r, _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+    __m256i pow2 = _mm256_slli_epi32(_mm256_add_epi32(k, _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(pow2));
+}
+
+float ExpSum(float *x, float max, uint32_t n) {
+    __m256 vmax = _mm256_set1_ps(max);
+    __m256 acc = _mm256_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 e = Exp(_mm256_sub_ps(_mm256_loadu_ps(x + i), vmax));
+        _mm256_storeu_ps(x + i, e);
+        acc = _mm256_add_ps(acc, e);
+    }
+    float sum = HorizontalSum(acc);
+    for (; i < n; i++) {
+        x[i] = __builtin_expf(x[i] - max);
+        sum += x[i];
+    }
+    return sum;
+}
+
+template<uint32_t N>
+void AxpyRows(float *y, const float *x, const float *a, uint32_t m, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    uint32_t j = 0;
+    // 32 floats of y in 4 registers over all rows
+    for (; j + 32 <= n; j += 32) {
+        __m256 y0 = _mm256_loadu_ps(y + j);
+        __m256 y1 = _mm256_loadu_ps(y + j + 8);
+        __m256 y2 = _mm256_loadu_ps(y + j + 16);
+        __m256 y3 = _mm256_loadu_ps(y + j + 24);
+        const float *row = x + j;
+        for (uint32_t i = 0; i < m; i++, row += n) {
+            __m256 va = _mm256_set1_ps(a[i]);
+            y0 = _mm256_fmadd_ps(va, _mm256_loadu_ps(row), y0);
+            y1 = _mm256_fmadd_ps(va, _mm256_loadu_ps(row + 8), y1);
+            y2 = _mm256_fmadd_ps(va, _mm256_loadu_ps(row + 16), y2);
+            y3 = _mm256_fmadd_ps(va, _mm256_loadu_ps(row + 24), y3);
+        }
+        _mm256_storeu_ps(y + j, y0);
+        _mm256_storeu_ps(y + j + 8, y1);
+        _mm256_storeu_ps(y + j + 16, y2);
+        _mm256_storeu_ps(y + j + 24, y3);
+    }
+    for (; j + 8 <= n; j += 8) {
+        __m256 y0 = _mm256_loadu_ps(y + j);
+        for (uint32_t i = 0; i < m; i++) {
+            y0 = _mm256_fmadd_ps(_mm256_set1_ps(a[i]),
+                                 _mm256_loadu_ps(x + uint64_t(i) * n + j), y0);
+        }
+        _mm256_storeu_ps(y + j, y0);
+    }
+    for (; j < n; j++) {
+        for (uint32_t i = 0; i < m; i++) {
+            y[j] += a[i] * x[uint64_t(i) * n + j];
+        }
+    }
+}
+
+template<uint32_t N>
+void Scale(float *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m256 va = _mm256_set1_ps(a);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(x + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), va));
+    }
+    for (; i < n; i++) {
+        x[i] *= a;
+    }
+}
+
+template<uint32_t N>
+float Norm(const float *x, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    return __builtin_sqrtf(Dot<N>(x, x, n));
+}
+
+// N > 0 fixes the trip count of every loop at compile time
+template<uint32_t N>
+void FillKernels(Kernels *kernels) {
+    kernels->dot = Dot<N>;
+    kernels->dot_rows = DotRows<N>;
+    kernels->dot_mask = DotMask<N>;
+    kernels->axpy = Axpy<N>;
+    kernels->axpy_mask = AxpyMask<N>;
+    kernels->axpy_grad = AxpyGrad<N>;
+    kernels->axpy_rows = AxpyRows<N>;
+    kernels->axpy_i8 = AxpyInt8<N>;
+    kernels->scale = Scale<N>;
+    kernels->norm = Norm<N>;
+    kernels->exp_sum = ExpSum;
+}
+} // namespace
+
+bool GetAvx2Kernels(Kernels *kernels, uint32_t dim) {
+    kernels->name = "avx2";
+    if (dim == 64) {
+        FillKernels<64>(kernels);
+    } else if (dim == 128) {
+        FillKernels<128>(kernels);
+    } else if (dim == 256) {
+        FillKernels<256>(kernels);
+    } else {
+        FillKernels<0>(kernels);
+    }
+    return true;
+}
+} // namespace utils
+} // namespace knowledgeembedding
+#else
+namespace knowledgeembedding {
+namespace utils {
+bool GetAvx2Kernels(Kernels *kernels, uint32_t dim) {
+    return false;
+}
+} // namespace utils
+} // namespace knowledgeembedding
+#endif // __AVX2__ && __FMA__
@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#include "simdkernel.h"
+
+#if defined(__AVX512F__) && defined(__FMA__)
+#include <immintrin.h>
+
+namespace knowledgeembedding {
+namespace utils {
+namespace {
+// mask of the last n % 16 lanes, the masked lanes are never loaded
+inline __mmask16 TailMask(uint32_t n) {
+    return static_cast<__mmask16>((1u << (n & 15)) - 1);
+}
+
+template<uint32_t N>
+float Dot(const float *x, const float *y, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i + 16),
+                               _mm512_loadu_ps(y + i + 16), acc1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), acc0);
+    }
+    if (i < n) {
+        __mmask16 m = TailMask(n - i);
+        acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, x + i),
+                               _mm512_maskz_loadu_ps(m, y + i), acc1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+template<uint32_t N>
+void DotRows(float *out, const float *x, const float *y, uint32_t m, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    uint32_t i = 0;
+    // 4 rows share every load of y
+    for (; i + 4 <= m; i += 4) {
+        const float *x0 = x + uint64_t(i) * n;
+        const float *x1 = x0 + n;
+        const float *x2 = x1 + n;
+        const float *x3 = x2 + n;
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        __m512 acc2 = _mm512_setzero_ps();
+        __m512 acc3 = _mm512_setzero_ps();
+        for (uint32_t j = 0; j < n; j += 16) {
+            __mmask16 mask = j + 16 <= n ? __mmask16(0xFFFF) : TailMask(n - j);
+            __m512 vy = _mm512_maskz_loadu_ps(mask, y + j);
+            acc0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, x0 + j), vy, acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, x1 + j), vy, acc1);
+            acc2 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, x2 + j), vy, acc2);
+            acc3 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, x3 + j), vy, acc3);
+        }
+        out[i] = _mm512_reduce_add_ps(acc0);
+        out[i + 1] = _mm512_reduce_add_ps(acc1);
+        out[i + 2] = _mm512_reduce_add_ps(acc2);
+        out[i + 3] = _mm512_reduce_add_ps(acc3);
+    }
+    for (; i < m; i++) {
+        out[i] = Dot<N>(x + uint64_t(i) * n, y, n);
+    }
+}
+
+template<uint32_t N>
+float DotMask(const float *x, const float *y, const float *mask, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m512 acc = _mm512_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 xy = _mm512_mul_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i));
+        acc = _mm512_fmadd_ps(xy, _mm512_loadu_ps(mask + i), acc);
+    }
+    if (i < n) {
+        __mmask16 m = TailMask(n - i);
+        __m512 xy = _mm512_mul_ps(_mm512_maskz_loadu_ps(m, x + i),
+                                  _mm512_maskz_loadu_ps(m, y + i));
+        acc = _mm512_fmadd_ps(xy, _mm512_maskz_loadu_ps(m, mask + i), acc);
+    }
+    return _mm512_reduce_add_ps(acc);
+}
+
+template<uint32_t N>
+void Axpy(float *y, const float *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m512 va = _mm512_set1_ps(a);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 vy = _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i));
+        _mm512_storeu_ps(y + i, vy);
+    }
+    if (i < n) {
+        __mmask16 m = TailMask(n - i);
+        __m512 vy = _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, x + i),
+                                    _mm512_maskz_loadu_ps(m, y + i));
+        _mm512_mask_storeu_ps(y + i, m, vy);
+    }
+}
+
+template<uint32_t N>
+void AxpyInt8(float *y, const int8_t *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m512 va = _mm512_set1_ps(a);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i xi = _mm512_cvtepi8_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i)));
+        __m512 vy = _mm512_fmadd_ps(va, _mm512_cvtepi32_ps(xi), _mm512_loadu_ps(y + i));
+        _mm512_storeu_ps(y + i, vy);
+    }
+    // byte masked loads need avx512bw, the tail is scalar
+    for (; i < n; i++) {
+        y[i] += a * x[i];
+    }
+}
+
+template<uint32_t N>
+void AxpyMask(float *y, const float *x, const float *mask, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m512 va = _mm512_set1_ps(a);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 ax = _mm512_mul_ps(va, _mm512_loadu_ps(x + i));
+        __m512 vy = _mm512_fmadd_ps(ax, _mm512_loadu_ps(mask + i), _mm512_loadu_ps(y + i));
+        _mm512_storeu_ps(y + i, vy);
+    }
+    if (i < n) {
+        __mmask16 m = TailMask(n - i);
+        __m512 ax = _mm512_mul_ps(va, _mm512_maskz_loadu_ps(m, x + i));
+        __m512 vy = _mm512_fmadd_ps(ax, _mm512_maskz_loadu_ps(m, mask + i),
+                                    _mm512_maskz_loadu_ps(m, y + i));
+        _mm512_mask_storeu_ps(y + i, m, vy);
+    }
+}
+
+template<uint32_t N>
+void AxpyGrad(float *g, float *y, const float *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m512 va = _mm512_set1_ps(a);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 vy = _mm512_loadu_ps(y + i);
+        _mm512_storeu_ps(g + i, _mm512_fmadd_ps(va, vy, _mm512_loadu_ps(g + i)));
+        _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), vy));
+    }
+    if (i < n) {
+        __mmask16 m = TailMask(n - i);
+        __m512 vy = _mm512_maskz_loadu_ps(m, y + i);
+        _mm512_mask_storeu_ps(g + i, m,
+                              _mm512_fmadd_ps(va, vy, _mm512_maskz_loadu_ps(m, g + i)));
+        _mm512_mask_storeu_ps(y + i, m,
+                              _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, x + i), vy));
+    }
+}
+
+// exp(x) of x in [-87, 0]: 2^k * p(r) with x = k * ln2 + r, p is the
+// cephes polynomial of expf
+inline __m512 Exp(__m512 x) {
+    x = _mm512_max_ps(x, _mm512_set1_ps(-87.0f));
+    __m512i k = _mm512_cvtps_epi32(_mm512_mul_ps(x, _mm512_set1_ps(1.44269504088896341f)));
+    __m512 fk = _mm512_cvtepi32_ps(k);
+    __m512 r = _mm512_fnmadd_ps(fk, _mm512_set1_ps(0.693359375f), x);
+    r = _mm512_fnmadd_ps(fk, _mm512_set1_ps(-2.12194440e-4f), r);
+    __m512 p = _mm512_set1_ps(1.9875691500e-4f);
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.3981999507e-3f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(8.3334519073e-3f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(4.1665795894e-2f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.6666665459e-1f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(5.0000001201e-1f));
+    p = _mm512_fmadd_ps(_mm512_mul_ps(p, r), r, _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+    __m512i pow2 = _mm512_slli_epi32(_mm512_add_epi32(k, _mm512_set1_epi32(127)), 23);
+    return _mm512_mul_ps(p, _mm512_castsi512_ps(pow2));
+}
+
+float ExpSum(float *x, float max, uint32_t n) {
+    __m512 vmax = _mm512_set1_ps(max);
+    __m512 acc = _mm512_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 e = Exp(_mm512_sub_ps(_mm512_loadu_ps(x + i), vmax));
+        _mm512_storeu_ps(x + i, e);
+        acc = _mm512_add_ps(acc, e);
+    }
+    if (i < n) {
+        __mmask16 m = TailMask(n - i);
+        __m512 e = Exp(_mm512_sub_ps(_mm512_maskz_loadu_ps(m, x + i), vmax));
+        _mm512_mask_storeu_ps(x + i, m, e);
+        acc = _mm512_mask_add_ps(acc, m, acc, e);
+    }
+    return _mm512_reduce_add_ps(acc);
+}
+
+template<uint32_t N>
+void AxpyRows(float *y, const float *x, const float *a, uint32_t m, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    uint32_t j = 0;
+    // 64 floats of y in 4 registers over all rows
+    for (; j + 64 <= n; j += 64) {
+        __m512 y0 = _mm512_loadu_ps(y + j);
+        __m512 y1 = _mm512_loadu_ps(y + j + 16);
+        __m512 y2 = _mm512_loadu_ps(y + j + 32);
+        __m512 y3 = _mm512_loadu_ps(y + j + 48);
+        const float *row = x + j;
+        for (uint32_t i = 0; i < m; i++, row += n) {
+            __m512 va = _mm512_set1_ps(a[i]);
+            y0 = _mm512_fmadd_ps(va, _mm512_loadu_ps(row), y0);
+            y1 = _mm512_fmadd_ps(va, _mm512_loadu_ps(row + 16), y1);
+            y2 = _mm512_fmadd_ps(va, _mm512_loadu_ps(row + 32), y2);
+            y3 = _mm512_fmadd_ps(va, _mm512_loadu_ps(row + 48), y3);
+        }
+        _mm512_storeu_ps(y + j, y0);
+        _mm512_storeu_ps(y + j + 16, y1);
+        _mm512_storeu_ps(y + j + 32, y2);
+        _mm512_storeu_ps(y + j + 48, y3);
+    }
+    for (; j < n; j += 16) {
+        __mmask16 mask = j + 16 <= n ? __mmask16(0xFFFF) : TailMask(n - j);
+        __m512 y0 = _mm512_maskz_loadu_ps(mask, y + j);
+        for (uint32_t i = 0; i < m; i++) {
+            y0 = _mm512_fmadd_ps(_mm512_set1_ps(a[i]),
+                                 _mm512_maskz_loadu_ps(mask, x + uint64_t(i) * n + j), y0);
+        }
+        _mm512_mask_storeu_ps(y + j, mask, y0);
+    }
+}
+
+template<uint32_t N>
+void Scale(float *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m512 va = _mm512_set1_ps(a);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(x + i, _mm512_mul_ps(_mm512_loadu_ps(x + i), va));
+    }
+    if (i < n) {
+        __mmask16 m = TailMask(n - i);
+        _mm512_mask_storeu_ps(x + i, m,
+                              _mm512_mul_ps(_mm512_maskz_loadu_ps(m, x + i), va));
+    }
+}
+
+template<uint32_t N>
+float Norm(const float *x, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    return __builtin_sqrtf(Dot<N>(x, x, n));
+}
+
+// N > 0 fixes the trip count of every loop at compile time
+template<uint32_t N>
+void FillKernels(Kernels *kernels) {
+    kernels->dot = Dot<N>;
+    kernels->dot_rows = DotRows<N>;
+    kernels->dot_mask = DotMask<N>;
+    kernels->axpy = Axpy<N>;
+    kernels->axpy_mask = AxpyMask<N>;
+    kernels->axpy_grad = AxpyGrad<N>;
+    kernels->axpy_rows = AxpyRows<N>;
+    kernels->axpy_i8 = AxpyInt8<N>;
+    kernels->scale = Scale<N>;
+    kernels->norm = Norm<N>;
+    kernels->exp_sum = ExpSum;
+}
+} // namespace
+
+bool GetAvx512Kernels(Kernels *kernels, uint32_t dim) {
+    kernels->name = "avx512";
+    if (dim == 64) {
+        FillKernels<64>(kernels);
+    } else if (dim == 128) {
+        FillKernels<128>(kernels);
+    } else if (dim == 256) {
+        FillKernels<256>(kernels);
+    } else {
+        FillKernels<0>(kernels);
+    }
+    return true;
+}
+} // namespace utils
+} // namespace knowledgeembedding
+#else
+namespace knowledgeembedding {
+namespace utils {
+bool GetAvx512Kernels(Kernels *kernels, uint32_t dim) {
+    return false;
+}
+} // namespace utils
+} // namespace knowledgeembedding
+#endif // __AVX512F__ && __FMA__
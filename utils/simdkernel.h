@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#ifndef KNOWLEDGE_EMBEDDING_UTILS_SIMDKERNEL_H
+#define KNOWLEDGE_EMBEDDING_UTILS_SIMDKERNEL_H
+
+// This header is included by the translation units compiled with
+// -msse2 / -mavx2 / -mavx512f, keep it free of inline code so that no
+// instruction set specific copy of a shared inline function can leak
+// into the rest of the program.
+#include <stdint.h>
+
+namespace knowledgeembedding {
+namespace utils {
+    // vector kernels on raw float arrays of n elements
+    struct Kernels {
+        const char *name;
+        // sum(x * y)
+        float (*dot)(const float *x, const float *y, uint32_t n);
+        // out[i] = sum(x[i * n, i * n + n) * y) of m rows
+        void (*dot_rows)(float *out, const float *x, const float *y,
+                         uint32_t m, uint32_t n);
+        // sum(x * y * mask)
+        float (*dot_mask)(const float *x, const float *y,
+                          const float *mask, uint32_t n);
+        // y += a * x
+        void (*axpy)(float *y, const float *x, float a, uint32_t n);
+        // y += a * x * mask
+        void (*axpy_mask)(float *y, const float *x, const float *mask,
+                          float a, uint32_t n);
+        // g += a * y, then y += a * x, one pass over the row y
+        void (*axpy_grad)(float *g, float *y, const float *x, float a, uint32_t n);
+        // y += sum(a[i] * x[i * n, i * n + n)) of m rows, y stays in
+        // registers while the rows stream by
+        void (*axpy_rows)(float *y, const float *x, const float *a,
+                          uint32_t m, uint32_t n);
+        // y += a * x of an int8 x
+        void (*axpy_i8)(float *y, const int8_t *x, float a, uint32_t n);
+        // x *= a
+        void (*scale)(float *x, float a, uint32_t n);
+        // sqrt(sum(x * x))
+        float (*norm)(const float *x, uint32_t n);
+        // x = exp(x - max) and return sum(x), max >= every x. the simd
+        // versions use a polynomial exp (relative error about 1e-7) and
+        // the n of any dim
+        float (*exp_sum)(float *x, float max, uint32_t n);
+    };
+
+    // fill kernels of the instruction set, return false if this
+    // binary was built without it.
+    // dim 64 / 128 / 256 gives kernels fully unrolled for n == dim which
+    // ignore the n argument, any other dim gives the generic kernels
+    bool GetSse2Kernels(Kernels *kernels, uint32_t dim);
+    bool GetAvx2Kernels(Kernels *kernels, uint32_t dim);
+    bool GetAvx512Kernels(Kernels *kernels, uint32_t dim);
+} // namespace utils
+} // namespace knowledgeembedding
+#endif // KNOWLEDGE_EMBEDDING_UTILS_SIMDKERNEL_H
@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#include "simdkernel.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+namespace knowledgeembedding {
+namespace utils {
+namespace {
+inline float HorizontalSum(__m128 v) {
+    __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+template<uint32_t N>
+float Dot(const float *x, const float *y, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x + i + 4),
+                                           _mm_loadu_ps(y + i + 4)));
+    }
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+    }
+    float res = HorizontalSum(_mm_add_ps(acc0, acc1));
+    for (; i < n; i++) {
+        res += x[i] * y[i];
+    }
+    return res;
+}
+
+template<uint32_t N>
+void DotRows(float *out, const float *x, const float *y, uint32_t m, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    uint32_t i = 0;
+    // 4 rows share every load of y
+    for (; i + 4 <= m; i += 4) {
+        const float *x0 = x + uint64_t(i) * n;
+        const float *x1 = x0 + n;
+        const float *x2 = x1 + n;
+        const float *x3 = x2 + n;
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        __m128 acc2 = _mm_setzero_ps();
+        __m128 acc3 = _mm_setzero_ps();
+        uint32_t j = 0;
+        for (; j + 4 <= n; j += 4) {
+            __m128 vy = _mm_loadu_ps(y + j);
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x0 + j), vy));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x1 + j), vy));
+            acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_loadu_ps(x2 + j), vy));
+            acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_loadu_ps(x3 + j), vy));
+        }
+        out[i] = HorizontalSum(acc0);
+        out[i + 1] = HorizontalSum(acc1);
+        out[i + 2] = HorizontalSum(acc2);
+        out[i + 3] = HorizontalSum(acc3);
+        for (; j < n; j++) {
+            out[i] += x0[j] * y[j];
+            out[i + 1] += x1[j] * y[j];
+            out[i + 2] += x2[j] * y[j];
+            out[i + 3] += x3[j] * y[j];
+        }
+    }
+    for (; i < m; i++) {
+        out[i] = Dot<N>(x + uint64_t(i) * n, y, n);
+    }
+}
+
+template<uint32_t N>
+float DotMask(const float *x, const float *y, const float *mask, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m128 acc = _mm_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 xy = _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i));
+        acc = _mm_add_ps(acc, _mm_mul_ps(xy, _mm_loadu_ps(mask + i)));
+    }
+    float res = HorizontalSum(acc);
+    for (; i < n; i++) {
+        res += x[i] * y[i] * mask[i];
+    }
+    return res;
+}
+
+template<uint32_t N>
+void Axpy(float *y, const float *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m128 va = _mm_set1_ps(a);
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 vy = _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, _mm_loadu_ps(x + i)));
+        _mm_storeu_ps(y + i, vy);
+    }
+    for (; i < n; i++) {
+        y[i] += a * x[i];
+    }
+}
+
+template<uint32_t N>
+void AxpyInt8(float *y, const int8_t *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m128 va = _mm_set1_ps(a);
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // sign extend 4 bytes to int32: put each byte on top and shift back
+        int32_t bytes;
+        __builtin_memcpy(&bytes, x + i, 4);
+        __m128i b = _mm_cvtsi32_si128(bytes);
+        b = _mm_unpacklo_epi8(b, b);
+        b = _mm_srai_epi32(_mm_unpacklo_epi16(b, b), 24);
+        __m128 vy = _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, _mm_cvtepi32_ps(b)));
+        _mm_storeu_ps(y + i, vy);
+    }
+    for (; i < n; i++) {
+        y[i] += a * x[i];
+    }
+}
+
+template<uint32_t N>
+void AxpyMask(float *y, const float *x, const float *mask, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m128 va = _mm_set1_ps(a);
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 ax = _mm_mul_ps(va, _mm_loadu_ps(x + i));
+        __m128 vy = _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(ax, _mm_loadu_ps(mask + i)));
+        _mm_storeu_ps(y + i, vy);
+    }
+    for (; i < n; i++) {
+        y[i] += a * x[i] * mask[i];
+    }
+}
+
+template<uint32_t N>
+void AxpyGrad(float *g, float *y, const float *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m128 va = _mm_set1_ps(a);
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 vy = _mm_loadu_ps(y + i);
+        _mm_storeu_ps(g + i, _mm_add_ps(_mm_loadu_ps(g + i), _mm_mul_ps(va, vy)));
+        _mm_storeu_ps(y + i, _mm_add_ps(vy, _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+    }
+    for (; i < n; i++) {
+        g[i] += a * y[i];
+        y[i] += a * x[i];
+    }
+}
+
+// exp(x) of x in [-87, 0]: 2^k * p(r) with x = k * ln2 + r, p is the
+// cephes polynomial of expf
+inline __m128 Exp(__m128 x) {
+    x = _mm_max_ps(x, _mm_set1_ps(-87.0f));
+    __m128i k = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)));
+    __m128 fk = _mm_cvtepi32_ps(k);
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(fk, _mm_set1_ps(0.693359375f)));
+    r = _mm_sub_ps(r, _mm_mul_ps(fk, _mm_set1_ps(-2.12194440e-4f)));
+    __m128 p = _mm_set1_ps(1.9875691500e-4f);
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.3981999507e-3f));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(8.3334519073e-3f));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(4.1665795894e-2f));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.6666665459e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(5.0000001201e-1f));
+    p = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, r), r), _mm_add_ps(r, _mm_set1_ps(1.0f)));
+    __m128i pow2 = _mm_slli_epi32(_mm_add_epi32(k, _mm_set1_epi32(127)), 23);
+    return _mm_mul_ps(p, _mm_castsi128_ps(pow2));
+}
+
+float ExpSum(float *x, float max, uint32_t n) {
+    __m128 vmax = _mm_set1_ps(max);
+    __m128 acc = _mm_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 e = Exp(_mm_sub_ps(_mm_loadu_ps(x + i), vmax));
+        _mm_storeu_ps(x + i, e);
+        acc = _mm_add_ps(acc, e);
+    }
+    float sum = HorizontalSum(acc);
+    for (; i < n; i++) {
+        x[i] = __builtin_expf(x[i] - max);
+        sum += x[i];
+    }
+    return sum;
+}
+
+template<uint32_t N>
+void AxpyRows(float *y, const float *x, const float *a, uint32_t m, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    uint32_t j = 0;
+    // 16 floats of y in 4 registers over all rows
+    for (; j + 16 <= n; j += 16) {
+        __m128 y0 = _mm_loadu_ps(y + j);
+        __m128 y1 = _mm_loadu_ps(y + j + 4);
+        __m128 y2 = _mm_loadu_ps(y + j + 8);
+        __m128 y3 = _mm_loadu_ps(y + j + 12);
+        const float *row = x + j;
+        for (uint32_t i = 0; i < m; i++, row += n) {
+            __m128 va = _mm_set1_ps(a[i]);
+            y0 = _mm_add_ps(y0, _mm_mul_ps(va, _mm_loadu_ps(row)));
+            y1 = _mm_add_ps(y1, _mm_mul_ps(va, _mm_loadu_ps(row + 4)));
+            y2 = _mm_add_ps(y2, _mm_mul_ps(va, _mm_loadu_ps(row + 8)));
+            y3 = _mm_add_ps(y3, _mm_mul_ps(va, _mm_loadu_ps(row + 12)));
+        }
+        _mm_storeu_ps(y + j, y0);
+        _mm_storeu_ps(y + j + 4, y1);
+        _mm_storeu_ps(y + j + 8, y2);
+        _mm_storeu_ps(y + j + 12, y3);
+    }
+    for (; j + 4 <= n; j += 4) {
+        __m128 y0 = _mm_loadu_ps(y + j);
+        for (uint32_t i = 0; i < m; i++) {
+            y0 = _mm_add_ps(y0, _mm_mul_ps(_mm_set1_ps(a[i]),
+                                           _mm_loadu_ps(x + uint64_t(i) * n + j)));
+        }
+        _mm_storeu_ps(y + j, y0);
+    }
+    for (; j < n; j++) {
+        for (uint32_t i = 0; i < m; i++) {
+            y[j] += a[i] * x[uint64_t(i) * n + j];
+        }
+    }
+}
+
+template<uint32_t N>
+void Scale(float *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    __m128 va = _mm_set1_ps(a);
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(x + i, _mm_mul_ps(_mm_loadu_ps(x + i), va));
+    }
+    for (; i < n; i++) {
+        x[i] *= a;
+    }
+}
+
+template<uint32_t N>
+float Norm(const float *x, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    return __builtin_sqrtf(Dot<N>(x, x, n));
+}
+
+// N > 0 fixes the trip count of every loop at compile time
+template<uint32_t N>
+void FillKernels(Kernels *kernels) {
+    kernels->dot = Dot<N>;
+    kernels->dot_rows = DotRows<N>;
+    kernels->dot_mask = DotMask<N>;
+    kernels->axpy = Axpy<N>;
+    kernels->axpy_mask = AxpyMask<N>;
+    kernels->axpy_grad = AxpyGrad<N>;
+    kernels->axpy_rows = AxpyRows<N>;
+    kernels->axpy_i8 = AxpyInt8<N>;
+    kernels->scale = Scale<N>;
+    kernels->norm = Norm<N>;
+    kernels->exp_sum = ExpSum;
+}
+} // namespace
+
+bool GetSse2Kernels(Kernels *kernels, uint32_t dim) {
+    kernels->name = "sse2";
+    if (dim == 64) {
+        FillKernels<64>(kernels);
+    } else if (dim == 128) {
+        FillKernels<128>(kernels);
+    } else if (dim == 256) {
+        FillKernels<256>(kernels);
+    } else {
+        FillKernels<0>(kernels);
+    }
+    return true;
+}
+} // namespace utils
+} // namespace knowledgeembedding
+#else
+namespace knowledgeembedding {
+namespace utils {
+bool GetSse2Kernels(Kernels *kernels, uint32_t dim) {
+    return false;
+}
+} // namespace utils
+} // namespace knowledgeembedding
+#endif // __SSE2__
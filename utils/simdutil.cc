@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#include "simdutil.h"
+
+#include <math.h>
+
+namespace knowledgeembedding {
+namespace utils {
+namespace {
+// dims with fully unrolled kernels, slot 0 holds the generic kernels
+const uint32_t kKernelDims[] = {0, 64, 128, 256};
+const uint32_t kKernelDimSize = sizeof(kKernelDims) / sizeof(kKernelDims[0]);
+
+bool IsUnrolledDim(uint32_t dim) {
+    for (uint32_t i = 1; i < kKernelDimSize; i++) {
+        if (kKernelDims[i] == dim) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template<uint32_t N>
+float DotScalar(const float *x, const float *y, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    float res = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        res += x[i] * y[i];
+    }
+    return res;
+}
+
+template<uint32_t N>
+void DotRowsScalar(float *out, const float *x, const float *y, uint32_t m, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    for (uint32_t i = 0; i < m; i++) {
+        out[i] = DotScalar<N>(x + uint64_t(i) * n, y, n);
+    }
+}
+
+template<uint32_t N>
+float DotMaskScalar(const float *x, const float *y, const float *mask, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    float res = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        res += x[i] * y[i] * mask[i];
+    }
+    return res;
+}
+
+template<uint32_t N>
+void AxpyScalar(float *y, const float *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    for (uint32_t i = 0; i < n; i++) {
+        y[i] += a * x[i];
+    }
+}
+
+template<uint32_t N>
+void AxpyMaskScalar(float *y, const float *x, const float *mask, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    for (uint32_t i = 0; i < n; i++) {
+        y[i] += a * x[i] * mask[i];
+    }
+}
+
+template<uint32_t N>
+void AxpyGradScalar(float *g, float *y, const float *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    for (uint32_t i = 0; i < n; i++) {
+        g[i] += a * y[i];
+        y[i] += a * x[i];
+    }
+}
+
+template<uint32_t N>
+void AxpyRowsScalar(float *y, const float *x, const float *a, uint32_t m, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    for (uint32_t i = 0; i < m; i++) {
+        AxpyScalar<N>(y, x + uint64_t(i) * n, a[i], n);
+    }
+}
+
+template<uint32_t N>
+void AxpyInt8Scalar(float *y, const int8_t *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    for (uint32_t i = 0; i < n; i++) {
+        y[i] += a * x[i];
+    }
+}
+
+template<uint32_t N>
+void ScaleScalar(float *x, float a, uint32_t size) {
+    const uint32_t n = N > 0 ? N : size;
+    for (uint32_t i = 0; i < n; i++) {
+        x[i] *= a;
+    }
+}
+
+template<uint32_t N>
+float NormScalar(const float *x, uint32_t size) {
+    return sqrt(DotScalar<N>(x, x, size));
+}
+
+float ExpSumScalar(float *x, float max, uint32_t n) {
+    float sum = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        x[i] = exp(x[i] - max);
+        sum += x[i];
+    }
+    return sum;
+}
+
+template<uint32_t N>
+void FillScalarKernels(Kernels *kernels) {
+    kernels->name = "scalar";
+    kernels->dot = DotScalar<N>;
+    kernels->dot_rows = DotRowsScalar<N>;
+    kernels->dot_mask = DotMaskScalar<N>;
+    kernels->axpy = AxpyScalar<N>;
+    kernels->axpy_mask = AxpyMaskScalar<N>;
+    kernels->axpy_grad = AxpyGradScalar<N>;
+    kernels->axpy_rows = AxpyRowsScalar<N>;
+    kernels->axpy_i8 = AxpyInt8Scalar<N>;
+    kernels->scale = ScaleScalar<N>;
+    kernels->norm = NormScalar<N>;
+    kernels->exp_sum = ExpSumScalar;
+}
+
+bool CpuSupports(const string &isa) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (isa == "sse2") {
+        return __builtin_cpu_supports("sse2");
+    } else if (isa == "avx2") {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    } else if (isa == "avx512") {
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma");
+    }
+#endif
+    return isa == "scalar";
+}
+
+bool SelectKernels(const string &isa, uint32_t dim, Kernels *kernels) {
+    if (isa == "auto") {
+        return SelectKernels("avx512", dim, kernels)
+            || SelectKernels("avx2", dim, kernels)
+            || SelectKernels("sse2", dim, kernels)
+            || SelectKernels("scalar", dim, kernels);
+    }
+    if (!CpuSupports(isa)) {
+        return false;
+    }
+    Kernels k;
+    bool res = false;
+    if (isa == "scalar") {
+        GetScalarKernels(&k, dim);
+        res = true;
+    } else if (isa == "sse2") {
+        res = GetSse2Kernels(&k, dim);
+    } else if (isa == "avx2") {
+        res = GetAvx2Kernels(&k, dim);
+    } else if (isa == "avx512") {
+        res = GetAvx512Kernels(&k, dim);
+    }
+    if (res) {
+        *kernels = k;
+    }
+    return res;
+}
+
+Kernels* CurrentKernels() {
+    static Kernels* kernels = []() {
+        static Kernels k[kKernelDimSize];
+        for (uint32_t i = 0; i < kKernelDimSize; i++) {
+            SelectKernels("auto", kKernelDims[i], &k[i]);
+        }
+        return k;
+    }();
+    return kernels;
+}
+
+bool IsClose(float val, float ref, float scale) {
+    return fabs(val - ref) <= 1e-4 * (1 + fabs(ref) + scale);
+}
+
+bool CheckKernels(const Kernels &kernels, const Kernels &scalar, uint32_t n) {
+    minstd_rand rng(n);
+    uniform_real_distribution<> uniform(-1, 1);
+    vector<float> x(n), y(n), mask(n);
+    float scale = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        x[i] = uniform(rng);
+        y[i] = uniform(rng);
+        mask[i] = uniform(rng) < 0 ? 0 : 2;
+        scale += fabs(x[i] * y[i]) * 2;
+    }
+    if (!IsClose(kernels.dot(x.data(), y.data(), n),
+                 scalar.dot(x.data(), y.data(), n), scale)
+        || !IsClose(kernels.dot_mask(x.data(), y.data(), mask.data(), n),
+                    scalar.dot_mask(x.data(), y.data(), mask.data(), n), scale)
+        || !IsClose(kernels.norm(x.data(), n), scalar.norm(x.data(), n), scale)) {
+        return false;
+    }
+    vector<float> res(y), ref(y);
+    kernels.axpy(res.data(), x.data(), 0.3, n);
+    scalar.axpy(ref.data(), x.data(), 0.3, n);
+    kernels.axpy_mask(res.data(), x.data(), mask.data(), -0.7, n);
+    scalar.axpy_mask(ref.data(), x.data(), mask.data(), -0.7, n);
+    vector<float> res_g(x), ref_g(x);
+    kernels.axpy_grad(res_g.data(), res.data(), y.data(), 0.2, n);
+    scalar.axpy_grad(ref_g.data(), ref.data(), y.data(), 0.2, n);
+    // three rows: x, y and mask
+    vector<float> rows(x);
+    rows.insert(rows.end(), y.begin(), y.end());
+    rows.insert(rows.end(), mask.begin(), mask.end());
+    const float a[] = {0.5, -0.25, 0.1};
+    kernels.axpy_rows(res_g.data(), rows.data(), a, 3, n);
+    scalar.axpy_rows(ref_g.data(), rows.data(), a, 3, n);
+    float res_d[3], ref_d[3];
+    kernels.dot_rows(res_d, rows.data(), y.data(), 3, n);
+    scalar.dot_rows(ref_d, rows.data(), y.data(), 3, n);
+    for (uint32_t i = 0; i < 3; i++) {
+        if (!IsClose(res_d[i], ref_d[i], scale)) {
+            return false;
+        }
+    }
+    vector<int8_t> x8(n);
+    for (uint32_t i = 0; i < n; i++) {
+        x8[i] = int8_t(int32_t(x[i] * 127));
+    }
+    kernels.axpy_i8(res.data(), x8.data(), 0.01, n);
+    scalar.axpy_i8(ref.data(), x8.data(), 0.01, n);
+    kernels.scale(res.data(), 1.5, n);
+    scalar.scale(ref.data(), 1.5, n);
+    for (uint32_t i = 0; i < n; i++) {
+        if (!IsClose(res[i], ref[i], 0) || !IsClose(res_g[i], ref_g[i], 0)) {
+            return false;
+        }
+    }
+    // exp of a wide range, the sum is compared relative to its size
+    vector<float> res_e(n), ref_e(n);
+    for (uint32_t i = 0; i < n; i++) {
+        res_e[i] = ref_e[i] = x[i] * 40;
+    }
+    float max_e = *std::max_element(ref_e.begin(), ref_e.end());
+    float res_sum = kernels.exp_sum(res_e.data(), max_e, n);
+    float ref_sum = scalar.exp_sum(ref_e.data(), max_e, n);
+    if (fabs(res_sum - ref_sum) > 1e-5 * ref_sum) {
+        return false;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (fabs(res_e[i] - ref_e[i]) > 1e-5 * ref_e[i] + 1e-30) {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+bool InitKernels(const string &isa) {
+    Kernels kernels[kKernelDimSize];
+    for (uint32_t i = 0; i < kKernelDimSize; i++) {
+        if (!SelectKernels(isa, kKernelDims[i], &kernels[i])) {
+            return false;
+        }
+        if (!CheckKernels(kernels[i], kKernelDims[i])) {
+            cerr << "simd kernels " << kernels[i].name << " (dim "
+                << kKernelDims[i] << ") differ from scalar kernels, use scalar"
+                << endl;
+            GetScalarKernels(&kernels[i], kKernelDims[i]);
+        }
+    }
+    for (uint32_t i = 0; i < kKernelDimSize; i++) {
+        CurrentKernels()[i] = kernels[i];
+    }
+    return true;
+}
+
+const Kernels& GetKernels(uint32_t dim) {
+    Kernels *kernels = CurrentKernels();
+    for (uint32_t i = 1; i < kKernelDimSize; i++) {
+        if (kKernelDims[i] == dim) {
+            return kernels[i];
+        }
+    }
+    return kernels[0];
+}
+
+void GetScalarKernels(Kernels *kernels, uint32_t dim) {
+    if (dim == 64) {
+        FillScalarKernels<64>(kernels);
+    } else if (dim == 128) {
+        FillScalarKernels<128>(kernels);
+    } else if (dim == 256) {
+        FillScalarKernels<256>(kernels);
+    } else {
+        FillScalarKernels<0>(kernels);
+    }
+}
+
+bool CheckKernels(const Kernels &kernels, uint32_t dim) {
+    Kernels scalar;
+    GetScalarKernels(&scalar, 0);
+    if (IsUnrolledDim(dim)) {
+        // unrolled kernels only accept n == dim
+        return CheckKernels(kernels, scalar, dim);
+    }
+    const uint32_t sizes[] = {1, 3, 7, 8, 15, 16, 17, 31, 33, 64, 100, 128, 255, 256, 300};
+    for (uint32_t n : sizes) {
+        if (!CheckKernels(kernels, scalar, n)) {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace utils
+} // namespace knowledgeembedding
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2019. All rights reserved.
+ * Author: xinggao1991
+ */
+#ifndef KNOWLEDGE_EMBEDDING_UTILS_SIMDUTIL_H
+#define KNOWLEDGE_EMBEDDING_UTILS_SIMDUTIL_H
+
+#include <string>
+
+#include "basicutil.h"
+#include "simdkernel.h"
+
+namespace knowledgeembedding {
+namespace utils {
+    // select kernels by name: auto / scalar / sse2 / avx2 / avx512,
+    // auto picks the widest instruction set reported by cpuid.
+    // return false if the name is unknown or not supported by the cpu
+    bool InitKernels(const string &isa);
+    // kernels used by matrixutil and vectorutil.
+    // GetKernels(dim) of dim 64 / 128 / 256 returns kernels unrolled for
+    // vectors of exactly dim elements, otherwise the generic kernels
+    const Kernels& GetKernels(uint32_t dim = 0);
+    void GetScalarKernels(Kernels *kernels, uint32_t dim);
+    // compare kernels of dim with the scalar version on random data
+    bool CheckKernels(const Kernels &kernels, uint32_t dim);
+} // namespace utils
+} // namespace knowledgeembedding
+#endif // KNOWLEDGE_EMBEDDING_UTILS_SIMDUTIL_H
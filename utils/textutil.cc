@@ -68,6 +68,48 @@ void GetNgramWordList(const string &text,
     GetNgramWordList(parts, ngram_list, ngram);
 }
 
+void GetSegedWordList(string_view text, vector<string_view> &word_list) {
+    SplitView(text, ' ', word_list);
+    word_list.erase(remove_if(word_list.begin(), word_list.end(),
+                    [&](string_view e) {
+                        return e.empty();
+                    })
+                , word_list.end());
+}
+
+void GetNgramWordList(const vector<string_view> &word_list,
+                      vector<string_view> &ngram_list,
+                      uint32_t ngram,
+                      string *arena) {
+    ngram_list.clear();
+    arena->clear();
+    if (ngram <= 1) {
+        return;
+    }
+    // reserve first so the views stay valid while the arena is filled
+    size_t arena_size = 0;
+    for (uint32_t i = 0; i < word_list.size(); i++) {
+        size_t ngram_size = word_list[i].size();
+        for (uint32_t j = i+1; j < word_list.size() && j < i+ngram; j++) {
+            ngram_size += 1 + word_list[j].size();
+            arena_size += ngram_size;
+        }
+    }
+    arena->reserve(arena_size);
+    for (uint32_t i = 0; i < word_list.size(); i++) {
+        for (uint32_t j = i+1; j < word_list.size() && j < i+ngram; j++) {
+            size_t start = arena->size();
+            arena->append(word_list[i]);
+            for (uint32_t k = i+1; k <= j; k++) {
+                arena->push_back('_');
+                arena->append(word_list[k]);
+            }
+            ngram_list.push_back(string_view(arena->data() + start,
+                                             arena->size() - start));
+        }
+    }
+}
+
 uint32_t GetWordSize(const string &word, bool &is_single_byte) {
     if (word.size() == 0) {
         return 0;
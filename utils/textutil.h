@@ -27,6 +27,14 @@ namespace utils {
     void GetNgramWordList(const string &text,
                           vector<string> &ngram_list,
                           uint32_t ngram);
+    // string_view versions for the train path, the words are views into
+    // text and no memory is allocated once the vectors have grown
+    void GetSegedWordList(string_view text, vector<string_view> &word_list);
+    // the ngrams are views into arena, it is cleared and reused by each call
+    void GetNgramWordList(const vector<string_view> &word_list,
+                          vector<string_view> &ngram_list,
+                          uint32_t ngram,
+                          string *arena);
     // get word size:
     // size(one english word) = 1
     // size(one chinese word) = 1
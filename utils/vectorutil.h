@@ -8,6 +8,7 @@
 #include <string>
 #include <vector>
 #include "basicutil.h"
+#include "simdutil.h"
 
 namespace knowledgeembedding
 {
@@ -38,6 +39,32 @@ namespace utils
         }
         return res;
     }
+    // zeroed float buffer of dim elements, it lives on the stack and is
+    // 64 bytes aligned when DIM is known at compile time, DIM == 0 is the
+    // generic fallback on the heap
+    template<uint32_t DIM>
+    class DimBuffer {
+        public:
+            explicit DimBuffer(uint32_t dim) {
+                assert(dim == DIM);
+                Clear();
+            }
+            void Clear() { memset(data_, 0, sizeof(data_)); }
+            float* Data() { return data_; }
+
+        private:
+            alignas(64) float data_[DIM];
+    };
+    template<>
+    class DimBuffer<0> {
+        public:
+            explicit DimBuffer(uint32_t dim): data_(dim, 0) {}
+            void Clear() { std::fill(data_.begin(), data_.end(), 0); }
+            float* Data() { return data_.data(); }
+
+        private:
+            vector<float> data_;
+    };
     template<typename T>
     void Print(const vector<T> &vec) {
         string res = "";